@@ -12,5 +12,83 @@
 
 #include <alc.h>
 #include <al.h>
+#include <stdint.h>
+
+#ifndef AL_APIENTRY
+#define AL_APIENTRY
+#endif
+#ifndef ALC_APIENTRY
+#define ALC_APIENTRY
+#endif
+
+// The extension entry points are looked up at runtime, so we only
+// need the tokens and signatures. Older OpenAL headers (like the ones
+// in the bundled libraries) do not ship alext.h.
+
+#ifndef AL_SOFT_events
+#define AL_SOFT_events 1
+#define AL_EVENT_CALLBACK_FUNCTION_SOFT          0x19A2
+#define AL_EVENT_CALLBACK_USER_PARAM_SOFT        0x19A3
+#define AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT      0x19A4
+#define AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT  0x19A5
+#define AL_EVENT_TYPE_DISCONNECTED_SOFT          0x19A6
+typedef void (AL_APIENTRY*ALEVENTPROCSOFT)(ALenum eventType, ALuint object,
+                                           ALuint param, ALsizei length,
+                                           const ALchar* message,
+                                           void* userParam);
+typedef void (AL_APIENTRY*LPALEVENTCONTROLSOFT)(ALsizei count,
+                                                const ALenum* types,
+                                                ALboolean enable);
+typedef void (AL_APIENTRY*LPALEVENTCALLBACKSOFT)(ALEVENTPROCSOFT callback,
+                                                 void* userParam);
+#endif
+
+#ifndef AL_SOFT_source_latency
+#define AL_SOFT_source_latency 1
+#define AL_SAMPLE_OFFSET_LATENCY_SOFT            0x1200
+#define AL_SEC_OFFSET_LATENCY_SOFT               0x1201
+typedef int64_t ALint64SOFT;
+typedef uint64_t ALuint64SOFT;
+typedef void (AL_APIENTRY*LPALGETSOURCEDVSOFT)(ALuint source, ALenum param,
+                                               ALdouble* values);
+typedef void (AL_APIENTRY*LPALGETSOURCEI64VSOFT)(ALuint source, ALenum param,
+                                                 ALint64SOFT* values);
+#endif
+
+#ifndef ALC_SOFT_device_clock
+#define ALC_SOFT_device_clock 1
+#define ALC_DEVICE_CLOCK_SOFT                    0x1600
+#define ALC_DEVICE_LATENCY_SOFT                  0x1601
+#define ALC_DEVICE_CLOCK_LATENCY_SOFT            0x1602
+#define AL_SAMPLE_OFFSET_CLOCK_SOFT              0x1202
+#define AL_SEC_OFFSET_CLOCK_SOFT                 0x1203
+typedef int64_t ALCint64SOFT;
+typedef uint64_t ALCuint64SOFT;
+typedef void (ALC_APIENTRY*LPALCGETINTEGER64VSOFT)(ALCdevice* device,
+                                                   ALCenum pname,
+                                                   ALsizei size,
+                                                   ALCint64SOFT* values);
+#endif
+
+#ifndef AL_SOFT_source_start_delay
+#define AL_SOFT_source_start_delay 1
+typedef void (AL_APIENTRY*LPALSOURCEPLAYATTIMESOFT)(ALuint source,
+                                                    ALint64SOFT start_time);
+typedef void (AL_APIENTRY*LPALSOURCEPLAYATTIMEVSOFT)(ALsizei n,
+                                                     const ALuint* sources,
+                                                     ALint64SOFT start_time);
+#endif
+
+#ifndef ALC_SOFT_HRTF
+#define ALC_SOFT_HRTF 1
+#define ALC_HRTF_SOFT                            0x1992
+#define ALC_DONT_CARE_SOFT                       0x0002
+#define ALC_HRTF_STATUS_SOFT                     0x1993
+#endif
+
+#ifndef ALC_SOFT_output_limiter
+#define ALC_SOFT_output_limiter 1
+#define ALC_OUTPUT_LIMITER_SOFT                  0x199A
+#endif
 
 #endif // _OPENENGINE_OPENAL_H_
@@ -0,0 +1,138 @@
+// IMA ADPCM encoding of PCM data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/AdpcmEncoder.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+const unsigned int AdpcmEncoder::BLOCK_SAMPLES;
+const unsigned int AdpcmEncoder::BLOCK_BYTES;
+
+static const int STEPS[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int INDEX_STEPS[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static void Clamp(int& predictor, int& index) {
+    if (predictor > 32767) predictor = 32767;
+    if (predictor < -32768) predictor = -32768;
+    if (index < 0) index = 0;
+    if (index > 88) index = 88;
+}
+
+static int Delta(unsigned char code, int step) {
+    int delta = step >> 3;
+    if (code & 4) delta += step;
+    if (code & 2) delta += step >> 1;
+    if (code & 1) delta += step >> 2;
+    return (code & 8) ? -delta : delta;
+}
+
+// encode one sample, updating the decoder state the code leads to
+static unsigned char EncodeSample(int sample, int& predictor, int& index) {
+    int step = STEPS[index];
+    int diff = sample - predictor;
+    unsigned char code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    int delta = step >> 3;
+    if (diff >= step) { code |= 4; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { code |= 2; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { code |= 1; delta += step; }
+
+    predictor += (code & 8) ? -delta : delta;
+    index += INDEX_STEPS[code & 7];
+    Clamp(predictor, index);
+    return code;
+}
+
+unsigned int AdpcmEncoder::EncodedSize(unsigned int frames, unsigned int channels) {
+    unsigned int blocks = (frames + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+    return blocks * BLOCK_BYTES * channels;
+}
+
+void AdpcmEncoder::Encode(const short* in, unsigned int frames,
+                          unsigned int channels, std::vector<char>& out) {
+    out.resize(EncodedSize(frames, channels));
+    if (out.empty()) 
+        return;
+    unsigned char* o = (unsigned char*)&out[0];
+    // the step index carries over between blocks, the predictor is
+    // reset to the first sample of each
+    std::vector<int> index(channels, 0);
+    std::vector<int> predictor(channels, 0);
+    std::vector<short> block(BLOCK_SAMPLES * channels);
+
+    for (unsigned int start = 0; start < frames; start += BLOCK_SAMPLES) {
+        unsigned int count = frames - start;
+        if (count > BLOCK_SAMPLES) count = BLOCK_SAMPLES;
+        for (unsigned int i = 0; i < BLOCK_SAMPLES * channels; ++i)
+            block[i] = (i < count * channels) ? in[start * channels + i] : 0;
+
+        for (unsigned int c = 0; c < channels; ++c) {
+            predictor[c] = block[c];
+            o[0] = (unsigned char)(block[c] & 0xff);
+            o[1] = (unsigned char)((block[c] >> 8) & 0xff);
+            o[2] = (unsigned char)index[c];
+            o[3] = 0;
+            o += 4;
+        }
+        // eight samples of each channel per group, low nibble first
+        for (unsigned int group = 0; group < (BLOCK_SAMPLES - 1) / 8; ++group) {
+            for (unsigned int c = 0; c < channels; ++c) {
+                for (unsigned int k = 0; k < 8; k += 2) {
+                    unsigned int s = 1 + group * 8 + k;
+                    unsigned char lo = EncodeSample(block[s * channels + c],
+                                                    predictor[c], index[c]);
+                    unsigned char hi = EncodeSample(block[(s + 1) * channels + c],
+                                                    predictor[c], index[c]);
+                    *o++ = lo | (hi << 4);
+                }
+            }
+        }
+    }
+}
+
+void AdpcmEncoder::DecodeBlock(const char* in, unsigned int channels, short* out) {
+    const unsigned char* b = (const unsigned char*)in;
+    int predictor[2], index[2];
+    for (unsigned int c = 0; c < channels; ++c) {
+        predictor[c] = (short)(b[0] | (b[1] << 8));
+        index[c] = b[2];
+        Clamp(predictor[c], index[c]);
+        out[c] = (short)predictor[c];
+        b += 4;
+    }
+    for (unsigned int group = 0; group < (BLOCK_SAMPLES - 1) / 8; ++group) {
+        for (unsigned int c = 0; c < channels; ++c) {
+            for (unsigned int k = 0; k < 8; ++k) {
+                unsigned char code = (k & 1) ? (b[k / 2] >> 4) : (b[k / 2] & 0xf);
+                predictor[c] += Delta(code, STEPS[index[c]]);
+                index[c] += INDEX_STEPS[code & 7];
+                Clamp(predictor[c], index[c]);
+                out[(1 + group * 8 + k) * channels + c] = (short)predictor[c];
+            }
+            b += 4;
+        }
+    }
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,49 @@
+// IMA ADPCM encoding of PCM data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_ADPCM_ENCODER_H_
+#define _OE_ADPCM_ENCODER_H_
+
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+/**
+ * ADPCM encoder.
+ * Encodes interleaved 16 bit PCM to IMA ADPCM blocks in the layout
+ * AL_EXT_IMA4 takes at its default block alignment: 65 samples per
+ * channel in 36 bytes per channel, a little under a quarter of the
+ * 16 bit size. Each block starts with a header per channel holding
+ * its first sample and step index, followed by the remaining
+ * samples as 4 bit codes, eight per channel at a time. The last
+ * block is padded with silence. Blocks decode on their own, so
+ * encoded data can be played from any block.
+ *
+ * @class AdpcmEncoder AdpcmEncoder.h Sound/AdpcmEncoder.h
+ */
+class AdpcmEncoder {
+public:
+    static const unsigned int BLOCK_SAMPLES = 65; // per channel
+    static const unsigned int BLOCK_BYTES = 36;   // per channel
+
+    //! Size in bytes of frames frames once encoded.
+    static unsigned int EncodedSize(unsigned int frames, unsigned int channels);
+
+    static void Encode(const short* in, unsigned int frames,
+                       unsigned int channels, std::vector<char>& out);
+
+    //! Decode one block to BLOCK_SAMPLES interleaved frames.
+    static void DecodeBlock(const char* in, unsigned int channels, short* out);
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_ADPCM_ENCODER_H_
@@ -0,0 +1,105 @@
+// Sound clip held compressed in memory and decoded as it streams.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/CompressedClip.h>
+#include <Sound/AdpcmEncoder.h>
+
+#include <cstring>
+
+namespace OpenEngine {
+namespace Sound {
+
+using namespace OpenEngine::Resources;
+
+CompressedClip::CompressedClip(ISoundResourcePtr source, ClipDataPtr data,
+                               unsigned int frequency, unsigned int channels,
+                               unsigned int frames)
+    : source(source), owner(data), data(data->empty() ? NULL : &(*data)[0])
+    , size(data->size()), frequency(frequency)
+    , channels(channels), frames(frames), block(0), frame(0)
+    , pcm(AdpcmEncoder::BLOCK_SAMPLES * channels)
+    , pcmOffset(AdpcmEncoder::BLOCK_SAMPLES) {}
+
+CompressedClip::CompressedClip(std::tr1::shared_ptr<void> owner, 
+                               const char* data, unsigned int size,
+                               unsigned int frequency, unsigned int channels,
+                               unsigned int frames)
+    : owner(owner), data(data), size(size), frequency(frequency)
+    , channels(channels), frames(frames), block(0), frame(0)
+    , pcm(AdpcmEncoder::BLOCK_SAMPLES * channels)
+    , pcmOffset(AdpcmEncoder::BLOCK_SAMPLES) {
+    // never decode past the data, whatever frames claims
+    unsigned int blocks = size / (AdpcmEncoder::BLOCK_BYTES * channels);
+    if (this->frames > blocks * AdpcmEncoder::BLOCK_SAMPLES)
+        this->frames = blocks * AdpcmEncoder::BLOCK_SAMPLES;
+}
+
+ISoundResourcePtr CompressedClip::GetSource() {
+    return source;
+}
+
+unsigned int CompressedClip::GetCompressedSize() {
+    return size;
+}
+
+/**
+ * Decode blocks until size bytes are filled or the clip ends. The
+ * padding of the last block is never returned.
+ */
+unsigned int CompressedClip::GetBuffer(unsigned int size, char* buf) {
+    unsigned int frameSize = channels * sizeof(short);
+    unsigned int wanted = size / frameSize;
+    unsigned int written = 0;
+    unsigned int blockSize = AdpcmEncoder::BLOCK_BYTES * channels;
+    while (written < wanted && frame < frames) {
+        if (pcmOffset == AdpcmEncoder::BLOCK_SAMPLES) {
+            AdpcmEncoder::DecodeBlock(data + block * blockSize, channels, &pcm[0]);
+            block++;
+            pcmOffset = 0;
+        }
+        unsigned int count = AdpcmEncoder::BLOCK_SAMPLES - pcmOffset;
+        if (count > wanted - written) count = wanted - written;
+        if (count > frames - frame) count = frames - frame;
+        memcpy(buf + written * frameSize, &pcm[pcmOffset * channels],
+               count * frameSize);
+        pcmOffset += count;
+        written += count;
+        frame += count;
+    }
+    return written * frameSize;
+}
+
+unsigned int CompressedClip::GetFrequency() {
+    return frequency;
+}
+
+unsigned int CompressedClip::GetBitsPerSample() {
+    return 16;
+}
+
+SoundFormat CompressedClip::GetFormat() {
+    return channels == 2 ? STEREO : MONO;
+}
+
+unsigned int CompressedClip::GetNumberOfSamples() {
+    return frames;
+}
+
+void CompressedClip::Load() {
+    block = 0;
+    frame = 0;
+    pcmOffset = AdpcmEncoder::BLOCK_SAMPLES;
+}
+
+void CompressedClip::Unload() {
+    Load();
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,77 @@
+// Sound clip held compressed in memory and decoded as it streams.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_COMPRESSED_CLIP_H_
+#define _OE_COMPRESSED_CLIP_H_
+
+#include <Resources/ISoundResource.h>
+#include <Resources/IStreamingSoundResource.h>
+
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Resources::ISoundResourcePtr;
+using OpenEngine::Resources::IStreamingSoundResource;
+using OpenEngine::Resources::SoundFormat;
+
+typedef std::tr1::shared_ptr<std::vector<char> > ClipDataPtr;
+
+/**
+ * Compressed clip.
+ * A streaming resource over IMA ADPCM data in memory, see
+ * AdpcmEncoder. Each clip has its own read position, and clips of
+ * the same source share the encoded data, so playing a clip several
+ * times at once costs a position, not a copy. The data is either
+ * owned by the clips or borrowed from an owner they keep alive,
+ * such as a mapped sound bank. Samples come out as 16 bit. Unload
+ * and Load rewind to the start.
+ *
+ * @class CompressedClip CompressedClip.h Sound/CompressedClip.h
+ */
+class CompressedClip : public IStreamingSoundResource {
+private:
+    ISoundResourcePtr source;
+    std::tr1::shared_ptr<void> owner;
+    const char* data;
+    unsigned int size;
+    unsigned int frequency;
+    unsigned int channels;
+    unsigned int frames;
+    unsigned int block;       // next block to decode
+    unsigned int frame;       // frames handed out so far
+    std::vector<short> pcm;   // the last decoded block
+    unsigned int pcmOffset;   // frames of it handed out
+
+public:
+    CompressedClip(ISoundResourcePtr source, ClipDataPtr data,
+                   unsigned int frequency, unsigned int channels,
+                   unsigned int frames);
+    CompressedClip(std::tr1::shared_ptr<void> owner, const char* data,
+                   unsigned int size, unsigned int frequency,
+                   unsigned int channels, unsigned int frames);
+
+    //! The resource the clip was encoded from, if any.
+    ISoundResourcePtr GetSource();
+    unsigned int GetCompressedSize();
+
+    unsigned int GetBuffer(unsigned int size, char* buf);
+    unsigned int GetFrequency();
+    unsigned int GetBitsPerSample();
+    SoundFormat GetFormat();
+    unsigned int GetNumberOfSamples();
+    void Load();
+    void Unload();
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_COMPRESSED_CLIP_H_
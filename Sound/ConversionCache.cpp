@@ -0,0 +1,143 @@
+// Disk cache of converted sample data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/ConversionCache.h>
+
+#include <Logging/Logger.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace OpenEngine {
+namespace Sound {
+
+// file layout: magic, key, byte count, data
+static const char MAGIC[8] = { 'O','E','C','O','N','V','0','1' };
+
+ConversionCache::ConversionCache(string directory)
+    : directory(directory) {}
+
+void ConversionCache::SetDirectory(string directory) {
+    this->directory = directory;
+}
+
+string ConversionCache::GetDirectory() {
+    return directory;
+}
+
+bool ConversionCache::IsEnabled() {
+    return !directory.empty();
+}
+
+string ConversionCache::PathOf(uint64_t key) {
+    char name[32];
+    sprintf(name, "%016llx.pcm", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+bool ConversionCache::Load(uint64_t key, vector<char>& data) {
+    if (!IsEnabled()) return false;
+    std::ifstream file(PathOf(key).c_str(), std::ios::binary);
+    if (!file) return false;
+
+    char magic[8];
+    uint64_t stored;
+    uint32_t size;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&stored, sizeof(stored));
+    file.read((char*)&size, sizeof(size));
+    if (!file || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || stored != key)
+        return false;
+    data.resize(size);
+    if (size > 0)
+        file.read(&data[0], size);
+    // a short file is a write that did not finish
+    return file.gcount() == (std::streamsize)size || size == 0;
+}
+
+void ConversionCache::Store(uint64_t key, const vector<char>& data) {
+    if (!IsEnabled()) return;
+    string path = PathOf(key);
+    string temp = path + ".tmp";
+    {
+        std::ofstream file(temp.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            logger.warning << "Could not write conversion cache file "
+                           << temp << logger.end;
+            return;
+        }
+        uint32_t size = data.size();
+        file.write(MAGIC, sizeof(MAGIC));
+        file.write((const char*)&key, sizeof(key));
+        file.write((const char*)&size, sizeof(size));
+        if (size > 0)
+            file.write(&data[0], size);
+        if (!file) {
+            logger.warning << "Could not write conversion cache file "
+                           << temp << logger.end;
+            return;
+        }
+    }
+    // readers never see a partly written file
+    if (rename(temp.c_str(), path.c_str()) != 0)
+        remove(temp.c_str());
+}
+
+uint64_t ConversionCache::Hash(const char* data, unsigned int size, uint64_t hash) {
+    for (unsigned int i = 0; i < size; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t ConversionCache::Hash(uint64_t value, uint64_t hash) {
+    return Hash((const char*)&value, sizeof(value), hash);
+}
+
+static inline uint64_t Mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Four independent multiply-rotate lanes over 8 byte words, so the
+ * loop is bound by memory bandwidth rather than multiply latency.
+ * The tail and the length are folded in at the end.
+ */
+uint64_t ConversionCache::HashData(const char* data, unsigned int size,
+                                   uint64_t seed) {
+    const uint64_t K = 0x9e3779b97f4a7c15ULL;
+    uint64_t lane[4] = { seed, seed + K, seed ^ K, seed - K };
+    unsigned int words = size / 8;
+    unsigned int i = 0;
+    for (; i + 4 <= words; i += 4) {
+        for (unsigned int l = 0; l < 4; ++l) {
+            uint64_t w;
+            memcpy(&w, data + (i + l) * 8, 8);
+            lane[l] = (lane[l] ^ (w * K));
+            lane[l] = ((lane[l] << 31) | (lane[l] >> 33)) * 0x87c37b91114253d5ULL;
+        }
+    }
+    uint64_t h = Mix(lane[0]) ^ Mix(lane[1] + 1) ^ Mix(lane[2] + 2) ^ Mix(lane[3] + 3);
+    for (unsigned int offset = i * 8; offset < size; offset += 8) {
+        uint64_t w = 0;
+        memcpy(&w, data + offset, size - offset < 8 ? size - offset : 8);
+        h = Mix(h ^ (w * K));
+    }
+    return Mix(h ^ size);
+}
+
+} // NS Sound
+} // NS OpenEngine
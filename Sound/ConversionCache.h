@@ -0,0 +1,59 @@
+// Disk cache of converted sample data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_CONVERSION_CACHE_H_
+#define _OE_CONVERSION_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+using std::string;
+using std::vector;
+
+/**
+ * Conversion cache.
+ * Stores the result of converting sample data in a directory, one
+ * file per key, so the conversion is done once across runs. Keys are
+ * content hashes of the input mixed with the conversion parameters.
+ * Without a directory nothing is cached.
+ *
+ * @class ConversionCache ConversionCache.h Sound/ConversionCache.h
+ */
+class ConversionCache {
+private:
+    string directory;
+    string PathOf(uint64_t key);
+
+public:
+    ConversionCache(string directory = "");
+
+    void SetDirectory(string directory);
+    string GetDirectory();
+    bool IsEnabled();
+
+    bool Load(uint64_t key, vector<char>& data);
+    void Store(uint64_t key, const vector<char>& data);
+
+    //! 64 bit FNV-1a, continuing from hash.
+    static uint64_t Hash(const char* data, unsigned int size,
+                         uint64_t hash = 14695981039346656037ULL);
+    static uint64_t Hash(uint64_t value, uint64_t hash);
+    //! Word at a time hash for fingerprinting large buffers.
+    static uint64_t HashData(const char* data, unsigned int size,
+                             uint64_t seed = 0);
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_CONVERSION_CACHE_H_
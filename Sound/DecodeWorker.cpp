@@ -0,0 +1,118 @@
+// Background decoding of streaming sound resources.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/DecodeWorker.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+DecodeWorker::DecodeWorker(): running(false) {}
+
+DecodeWorker::~DecodeWorker() {
+    Stop();
+}
+
+void DecodeWorker::Start() {
+    if (running) return;
+    running = true;
+    Thread::Start();
+}
+
+void DecodeWorker::Stop() {
+    if (!running) return;
+    running = false;
+    queued.Post();
+    Wait();
+}
+
+bool DecodeWorker::IsRunning() {
+    return running;
+}
+
+void DecodeWorker::Add(DecodeJob* job) {
+    lock.Lock();
+    job->state = DecodeJob::QUEUED;
+    jobs.push_back(job);
+    lock.Unlock();
+    queued.Post();
+}
+
+bool DecodeWorker::Cancel(DecodeJob* job) {
+    bool cancelled = false;
+    lock.Lock();
+    for (std::deque<DecodeJob*>::iterator itr = jobs.begin();
+         itr != jobs.end();
+         ++itr) {
+        if (*itr == job) {
+            jobs.erase(itr);
+            cancelled = true;
+            break;
+        }
+    }
+    lock.Unlock();
+    return cancelled;
+}
+
+DecodeJob::State DecodeWorker::GetState(DecodeJob* job) {
+    lock.Lock();
+    DecodeJob::State state = job->state;
+    lock.Unlock();
+    return state;
+}
+
+void DecodeWorker::Finish(DecodeJob* job) {
+    // a job nobody will run is decoded by the caller
+    if (!running && Cancel(job)) {
+        job->state = DecodeJob::RUNNING;
+        Decode(job);
+        job->state = DecodeJob::DONE;
+        return;
+    }
+    // a post may be left from a job nobody waited for, so check
+    // again after each
+    while (GetState(job) != DecodeJob::DONE)
+        done.Wait();
+}
+
+void DecodeWorker::Decode(DecodeJob* job) {
+    for (unsigned int i = 0; i < job->chunks; ++i) {
+        unsigned int read =
+            job->resource->GetBuffer(job->chunkSize,
+                                     &job->data[i * job->chunkSize]);
+        job->sizes[i] = read;
+        if (read < job->chunkSize) break;
+    }
+}
+
+void DecodeWorker::Run() {
+    while (running) {
+        lock.Lock();
+        DecodeJob* job = NULL;
+        if (!jobs.empty()) {
+            job = jobs.front();
+            jobs.pop_front();
+            job->state = DecodeJob::RUNNING;
+        }
+        lock.Unlock();
+        if (!job) {
+            queued.Wait();
+            continue;
+        }
+
+        Decode(job);
+
+        lock.Lock();
+        job->state = DecodeJob::DONE;
+        lock.Unlock();
+        done.Post();
+    }
+}
+
+} // NS Sound
+} // NS OpenEngine
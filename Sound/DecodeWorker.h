@@ -0,0 +1,90 @@
+// Background decoding of streaming sound resources.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_DECODE_WORKER_H_
+#define _OE_DECODE_WORKER_H_
+
+#include <Core/Thread.h>
+#include <Core/Mutex.h>
+#include <Resources/IStreamingSoundResource.h>
+#include <Sound/Semaphore.h>
+
+#include <deque>
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Core::Thread;
+using OpenEngine::Core::Mutex;
+using OpenEngine::Resources::IStreamingSoundResourcePtr;
+
+/**
+ * A request to decode the next chunks of a streaming resource.
+ * The chunks are stored back to back in data, with the number of
+ * bytes actually read for each in sizes.
+ */
+class DecodeJob {
+public:
+    enum State { QUEUED, RUNNING, DONE };
+
+    IStreamingSoundResourcePtr resource;
+    unsigned int chunkSize;
+    unsigned int chunks;
+    std::vector<char> data;
+    std::vector<unsigned int> sizes;
+    State state;
+
+    DecodeJob(IStreamingSoundResourcePtr resource,
+              unsigned int chunkSize, unsigned int chunks)
+        : resource(resource), chunkSize(chunkSize), chunks(chunks)
+        , data(chunkSize * chunks), sizes(chunks, 0), state(QUEUED) {}
+};
+
+/**
+ * Decode worker.
+ * Runs decode jobs in order on a thread of its own, sleeping while
+ * there are none. While a job is queued or running the worker owns
+ * its resource; the caller must not touch it until the job is done
+ * or cancelled.
+ *
+ * @class DecodeWorker DecodeWorker.h Sound/DecodeWorker.h
+ */
+class DecodeWorker : public Thread {
+private:
+    Mutex lock;
+    Semaphore queued;   // posted for each job added
+    Semaphore done;     // posted for each job finished
+    std::deque<DecodeJob*> jobs;
+    volatile bool running;
+
+    void Decode(DecodeJob* job);
+
+public:
+    DecodeWorker();
+    ~DecodeWorker();
+
+    void Start();
+    void Stop();
+    bool IsRunning();
+
+    void Add(DecodeJob* job);
+    //! Remove a queued job. Returns false if it already started.
+    bool Cancel(DecodeJob* job);
+    DecodeJob::State GetState(DecodeJob* job);
+    //! Block until the job is done.
+    void Finish(DecodeJob* job);
+
+    void Run();
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_DECODE_WORKER_H_
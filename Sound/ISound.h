@@ -14,6 +14,7 @@
 #include <Math/Quaternion.h>
 #include <Resources/ISoundResource.h>
 
+#include <Core/IEvent.h>
 #include <Utils/Timer.h>
 
 namespace OpenEngine {
@@ -23,6 +24,29 @@ using OpenEngine::Math::Vector;
 using OpenEngine::Math::Quaternion;
 using namespace OpenEngine::Resources;
 using OpenEngine::Utils::Time;
+using OpenEngine::Core::IEvent;
+
+class ISound;
+
+/**
+ * Sound event argument.
+ * Reports playback state changes that happened on their own, ie. not
+ * as a direct result of calling Play(), Stop() or Pause().
+ *
+ * @class SoundEventArg ISound.h Sound/ISound.h
+ */
+class SoundEventArg {
+public:
+    enum Type {
+        FINISHED,    //!< playback reached the end of the sound
+        LOOPED,      //!< a looping sound wrapped around to the start
+        STARVED,     //!< a stream ran out of queued data before the end
+        DISCONNECTED //!< the output device was lost (sound is NULL)
+    };
+    Type type;
+    ISound* sound;
+    SoundEventArg(Type type, ISound* sound): type(type), sound(sound) {}
+};
 
 /**
  * ISound.
@@ -64,7 +88,32 @@ public:
 	virtual unsigned int GetLengthInSamples() = 0;
 	virtual Time GetLength() = 0;
 
-    // virtual Event<ActionEventArg>& ActionEvent() = 0;
+    /**
+     * Event raised when the sound finishes, loops or starves.
+     * Events are delivered from the sound system's process loop.
+     */
+    virtual IEvent<SoundEventArg>& SoundEvent() = 0;
+
+    /**
+     * Re-read the playback state from the driver.
+     * The state getters return values captured once per update by the
+     * sound system. Call this first when exact values are needed.
+     */
+    virtual void Refresh() = 0;
+
+    /**
+     * Seconds of the sound heard so far, with the output latency
+     * taken off. Sound systems that can should make this a smooth
+     * clock, cheap to read from any thread, that does not step back
+     * while playing.
+     */
+    virtual double GetPlaybackPosition() {
+        return GetElapsedTime().AsInt64() / 1000000.0;
+    }
+    //! Seconds from a sample being mixed to it being heard.
+    virtual double GetOutputLatency() {
+        return 0.0;
+    }
 
     Time GetTimeLeft() {
         return GetLength() - GetElapsedTime();
@@ -16,6 +16,7 @@
 
 #include <Core/IListener.h>
 #include <Renderers/IRenderer.h>
+#include <Math/Vector.h>
 
 #include <string>
 
@@ -33,6 +34,7 @@ using Resources::ISoundResourcePtr;
 using Resources::IStreamingSoundResourcePtr;
 using Scene::ISceneNode;
 using Renderers::RenderingEventArg;
+using Math::Vector;
 
 using std::string;
 
@@ -42,6 +44,22 @@ public:
 
     virtual ISound* CreateSound(ISoundResourcePtr resource) = 0;
     virtual ISound* CreateSound(IStreamingSoundResourcePtr resource) = 0;
+    /**
+     * Stop the sound and release its resources.
+     * The sound pointer is invalid after this call. A channel of a
+     * stereo sound destroys the stereo sound and both its channels.
+     */
+    virtual void DestroySound(ISound* sound) = 0;
+    /**
+     * Play a resource once at a position and forget about it.
+     * The voice is taken from a pool and returned to it when the
+     * sound ends.
+     *
+     * @return false if the sound could not be played.
+     */
+    virtual bool PlayOneShot(ISoundResourcePtr resource, 
+                             Vector<3,float> position,
+                             float gain = 1.0, float pitch = 1.0) = 0;
     //virtual void SetRoot(ISceneNode* node) = 0;
 	virtual void SetMasterGain(float gain) = 0;
 	virtual float GetMasterGain() = 0;
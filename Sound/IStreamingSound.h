@@ -0,0 +1,61 @@
+// Interface for a sound played from a stream.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _SOUND_ISTREAMINGSOUND_H_
+#define _SOUND_ISTREAMINGSOUND_H_
+
+#include <Sound/ISound.h>
+#include <Resources/IStreamingSoundResource.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Resources::IStreamingSoundResourcePtr;
+
+/**
+ * Streaming sound.
+ * A sound played from a stream, with a queue of resources to play
+ * after it on the same source.
+ *
+ * @class IStreamingSound IStreamingSound.h Sound/IStreamingSound.h
+ */
+class IStreamingSound : public ISound {
+public:
+    virtual ~IStreamingSound() {};
+
+    /**
+     * Queue a resource to start on the frame after the current one
+     * ends. With a crossfade it fades in over that time while the
+     * current one fades out. The resource must have the sample rate
+     * and the channels of the sound, except that a stereo sound takes
+     * any layout: mono is played on both sides and more channels are
+     * folded down to stereo as the resource is read. Other resources
+     * are refused with an exception.
+     */
+    virtual void Enqueue(IStreamingSoundResourcePtr resource,
+                         Time crossfade = Time(0,0)) = 0;
+    //! Drop the queued resources not yet started.
+    virtual void ClearQueue() = 0;
+    virtual unsigned int GetQueueLength() = 0;
+
+    /**
+     * Loop between two frames of the stream when looping, the end
+     * exclusive. An end of zero loops to the end of the stream. A
+     * looping sound goes on to its queued resources at the end of
+     * the pass it is in.
+     */
+    virtual void SetLoopPoints(unsigned int start, unsigned int end = 0) = 0;
+    virtual unsigned int GetLoopStart() = 0;
+    virtual unsigned int GetLoopEnd() = 0;
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif
@@ -8,6 +8,7 @@
 //--------------------------------------------------------------------
 
 #include <Sound/OpenALSoundSystem.h>
+#include <Sound/SampleKernels.h>
 
 #include <Logging/Logger.h>
 #include <Core/Exceptions.h>
@@ -17,6 +18,10 @@
 #include <Math/Math.h>
 #include <Display/IViewingVolume.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 namespace OpenEngine {
 namespace Sound {
 
@@ -28,6 +33,8 @@ using namespace OpenEngine::Core;
 using namespace OpenEngine::Math;  
 using namespace OpenEngine::Display;
 
+const OpenALSoundSystem::BusID OpenALSoundSystem::MASTER_BUS;
+
 void OpenALSoundSystem::MakeDeviceList() {
     devices.clear();
     const ALCchar* device = alcGetString( NULL, ALC_DEVICE_SPECIFIER );
@@ -50,35 +57,558 @@ OpenALSoundSystem::OpenALSoundSystem()
     : alcDevice(NULL)
     , alcContext(NULL)
     , device(0)
+    , deviceLatency(0,0)
+    , latencyProbes(0)
+    , fadeTime(1,0)
+    , errorPolicy(OE_OPENAL_ERROR_POLICY)
+    , hasEvents(false)
+    , alEventControlSOFT(NULL)
+    , alEventCallbackSOFT(NULL)
+    , alcGetInteger64vSOFT(NULL)
+    , alSourcePlayAtTimevSOFT(NULL)
+    , alGetSourcedvSOFT(NULL)
+    , oneShotVoices(32)
+    , culling(true)
+    , cullRange(1000.0)
+    , cullFrame(0)
+    , resampleToDevice(false)
+    , deviceFrequency(0)
+    , lodEnabled(false)
+    , prefetchHorizon(2,0)
+    , prefetchLimit(4)
+    , readAheadTime(2,0)
+    , streamWorkers(2)
+    , refillBudget(0,2000)
 {
     MakeDeviceList();
+    timer.Start();
+    lodDistance[0] = 250.0;
+    lodDistance[1] = 600.0;
+    memset(alFormats, 0, sizeof(alFormats));
+    memset(ima4Formats, 0, sizeof(ima4Formats));
+    buses.push_back(MixBus("master", MASTER_BUS, 1.0, false));
+    busNames["master"] = MASTER_BUS;
 }
     
 OpenALSoundSystem::~OpenALSoundSystem() {
+    ClearDuckingRules();
+}
 
+void OpenALSoundSystem::SetErrorPolicy(ErrorPolicy policy) {
+    // do not let errors from before the switch leak into the new mode
+    if (alcContext && errorPolicy == ERRORS_DEFERRED)
+        FlushErrors("policy change");
+    else if (alcContext)
+        alGetError();
+    errorPolicy = policy;
 }
 
-void OpenALSoundSystem::UpdatePosition(OpenALMonoSound* sound) {
-    if (!alcContext) return;
-    float pos[3];
-    sound->pos.ToArray(pos);
-    alSourcefv(sound->sourceID, AL_POSITION, pos);
+OpenALSoundSystem::ErrorPolicy OpenALSoundSystem::GetErrorPolicy() {
+    return errorPolicy;
+}
+
+OpenALSoundSystem::Stats OpenALSoundSystem::GetStats() {
+    return stats;
+}
+
+void OpenALSoundSystem::ResetStats() {
+    stats = Stats();
+}
+
+void OpenALSoundSystem::ReportError(ALenum error, const char* what) {
+    stats.errors++;
+    stats.lastError = error;
+    stats.lastErrorBatch = what;
+    throw Exception(what + Convert::ToString(error));
+}
+
+/**
+ * Check for errors raised by the calls made since the last flush.
+ * OpenAL only keeps the first error, so the batch is the best
+ * attribution we can give in deferred mode.
+ */
+void OpenALSoundSystem::FlushErrors(const char* batch) {
+    if (errorPolicy != ERRORS_DEFERRED) return;
+    ALenum error = alGetError();
+    if (error == AL_NO_ERROR) return;
+    stats.errors++;
+    stats.lastError = error;
+    stats.lastErrorBatch = batch;
+    logger.warning << "OpenAL error " << error << " during " 
+                   << batch << logger.end;
+}
+
+void OpenALSoundSystem::InitEvents() {
+    hasEvents = false;
+    if (!alIsExtensionPresent("AL_SOFT_events")) {
+        logger.info << "AL_SOFT_events not supported, polling source state." 
+                    << logger.end;
+        return;
+    }
+    alEventControlSOFT = (LPALEVENTCONTROLSOFT)
+        alGetProcAddress("alEventControlSOFT");
+    alEventCallbackSOFT = (LPALEVENTCALLBACKSOFT)
+        alGetProcAddress("alEventCallbackSOFT");
+    if (!alEventControlSOFT || !alEventCallbackSOFT) 
+        return;
+
+    ALenum types[3] = { AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT,
+                        AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT,
+                        AL_EVENT_TYPE_DISCONNECTED_SOFT };
+    alEventCallbackSOFT(&OpenALSoundSystem::EventCallback, this);
+    alEventControlSOFT(3, types, AL_TRUE);
     ALCenum error;
     if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("Error updating sound position: "
-		      + Convert::ToString(error));
+        logger.warning << "Could not enable AL_SOFT_events: " 
+                       << error << logger.end;
+        return;
+    }
+    hasEvents = true;
+}
+
+void AL_APIENTRY OpenALSoundSystem::EventCallback(ALenum eventType, 
+                                                  ALuint object,
+                                                  ALuint param, 
+                                                  ALsizei length,
+                                                  const ALchar* message,
+                                                  void* userParam) {
+    // called from the OpenAL event thread, so no AL calls in here.
+    OpenALSoundSystem* self = (OpenALSoundSystem*)userParam;
+    self->eventLock.Lock();
+    self->pendingEvents.push_back(PendingALEvent(eventType, object, param));
+    self->eventLock.Unlock();
+}
+
+IEvent<SoundEventArg>& OpenALSoundSystem::SoundEvent() {
+    return soundEvent;
+}
+
+void OpenALSoundSystem::FireEvent(SoundEventArg::Type type, 
+                                  OpenALMonoSound* sound) {
+    firedEvents.push_back(FiredEvent(&sound->soundEvent, 
+                                     SoundEventArg(type, sound)));
+    // the left channel speaks for the stereo sound
+    if (sound->stereo && sound->stereo->left == sound)
+        firedEvents.push_back(FiredEvent(&sound->stereo->soundEvent,
+                                         SoundEventArg(type, sound->stereo)));
+}
+
+void OpenALSoundSystem::FireEvent(SoundEventArg::Type type, 
+                                  OpenALStreamingSound* sound) {
+    firedEvents.push_back(FiredEvent(&sound->soundEvent, 
+                                     SoundEventArg(type, sound)));
+}
+
+SoundHandle OpenALSoundSystem::VoiceTable::Allocate(ISound* o, 
+                                                   OpenALMonoSound* m,
+                                                   OpenALStreamingSound* s) {
+    unsigned int i;
+    if (freeSlots.empty()) {
+        i = generation.size();
+        generation.push_back(1);
+        source.push_back(0);
+        buffer.push_back(0);
+        gain.push_back(10.0);
+        position.push_back(Vector<3,float>(0.0,0.0,0.0));
+        state.push_back(AL_INITIAL);
+        sampleOffset.push_back(0);
+        secOffset.push_back(0.0);
+        playOffset.push_back(0.0);
+        active.push_back(false);
+        listed.push_back(false);
+        oneShot.push_back(false);
+        maxDistance.push_back(1000.0);
+        group.push_back(-1);
+        groupPrev.push_back(-1);
+        groupNext.push_back(-1);
+        bus.push_back(MASTER_BUS);
+        busSlot.push_back(-1);
+        busPaused.push_back(false);
+        spatial.push_back(false);
+        culled.push_back(false);
+        audibleFrame.push_back(0);
+        checkFrame.push_back(0);
+        cullTime.push_back(Time(0,0));
+        length.push_back(0.0);
+        lod.push_back(0);
+        lodNext.push_back(-1);
+        pad.push_back(0);
+        padLength.push_back(0.0);
+        owner.push_back(NULL);
+        mono.push_back(NULL);
+        stream.push_back(NULL);
+    } else {
+        i = freeSlots.back();
+        freeSlots.pop_back();
+        source[i] = buffer[i] = 0;
+        gain[i] = 10.0;
+        position[i] = Vector<3,float>(0.0,0.0,0.0);
+        state[i] = AL_INITIAL;
+        sampleOffset[i] = 0;
+        secOffset[i] = 0.0;
+        playOffset[i] = 0.0;
+        active[i] = false;
+        oneShot[i] = false;
+        maxDistance[i] = 1000.0;
+        group[i] = groupPrev[i] = groupNext[i] = -1;
+        bus[i] = MASTER_BUS;
+        busSlot[i] = -1;
+        busPaused[i] = false;
+        spatial[i] = culled[i] = false;
+        lod[i] = 0;
+        lodNext[i] = -1;
+        pad[i] = 0;
+        padLength[i] = 0.0;
+        // listed is left alone, the slot may still be in activeVoices
+    }
+    owner[i] = o;
+    mono[i] = m;
+    stream[i] = s;
+    return SoundHandle(i, generation[i]);
+}
+
+void OpenALSoundSystem::VoiceTable::Release(SoundHandle handle) {
+    unsigned int i = handle.index;
+    owner[i] = NULL;
+    mono[i] = NULL;
+    stream[i] = NULL;
+    active[i] = false;
+    // skip zero so a released slot never matches the null handle
+    if (++generation[i] == 0) generation[i] = 1;
+    freeSlots.push_back(i);
+}
+
+bool OpenALSoundSystem::VoiceTable::IsValid(SoundHandle handle) const {
+    return !handle.IsNull() && 
+        handle.index < generation.size() &&
+        generation[handle.index] == handle.generation &&
+        owner[handle.index] != NULL;
+}
+
+unsigned int OpenALSoundSystem::VoiceTable::Size() const {
+    return generation.size();
+}
+
+/**
+ * Record a state change made by the sound system itself, and add or
+ * remove the voice from the set captured each update.
+ */
+void OpenALSoundSystem::SetSourceState(unsigned int voice, ALint state) {
+    voices.culled[voice] = false;
+    voices.state[voice] = state;
+    if (state == AL_STOPPED || state == AL_INITIAL) {
+        voices.sampleOffset[voice] = 0;
+        voices.secOffset[voice] = 0.0;
+        voices.playOffset[voice] = 0.0;
+        if (voices.mono[voice]) 
+            voices.mono[voice]->clock.Reset();
+        else if (voices.stream[voice])
+            voices.stream[voice]->clock.Reset();
+    }
+    // hold the clock where the voice was paused
+    if (state == AL_PAUSED && alcContext)
+        SamplePosition(voice, timer.GetElapsedTime());
+    bool active = (state == AL_PLAYING);
+    if (active != (bool)voices.active[voice])
+        CountPlaying(voices.bus[voice], active ? 1 : -1);
+    voices.active[voice] = active;
+    if (state == AL_STOPPED || state == AL_INITIAL) 
+        LeaveGroup(voice);
+    // inactive entries are dropped lazily by UpdateSourceStates
+    if (voices.active[voice] && !voices.listed[voice]) {
+        activeVoices.push_back(voice);
+        voices.listed[voice] = true;
+    }
+    // new sounds may start out of range. A voice is listed once for
+    // the next pass however often it is replayed before it
+    if (active && culling && voices.spatial[voice] &&
+        voices.checkFrame[voice] != cullFrame + 1) {
+        voices.checkFrame[voice] = cullFrame + 1;
+        cullCheck.push_back(voice);
     }
 }
-void OpenALSoundSystem::UpdatePosition(OpenALStreamingSound* sound) {
+
+void OpenALSoundSystem::SetInstancePolicy(ISoundResourcePtr resource, 
+                                          InstancePolicy policy) {
+    map<ISoundResource*, unsigned int>::iterator itr = 
+        groupIndex.find(resource.get());
+    if (itr != groupIndex.end()) {
+        // playing instances are kept, even above a lowered limit
+        groups[itr->second].policy = policy;
+        return;
+    }
+    groupIndex[resource.get()] = groups.size();
+    groups.push_back(InstanceGroup(policy));
+}
+
+void OpenALSoundSystem::ClearInstancePolicy(ISoundResourcePtr resource) {
+    map<ISoundResource*, unsigned int>::iterator itr = 
+        groupIndex.find(resource.get());
+    if (itr == groupIndex.end()) return;
+    // the group slot is reused as an unlimited policy, so voices
+    // still linked into it stay consistent
+    groups[itr->second].policy = InstancePolicy();
+}
+
+/**
+ * Decide whether the voice may start playing an instance of the
+ * resource. Plays within the retrigger time are rejected. At the
+ * instance limit the oldest or quietest instance is stopped, or the
+ * play is rejected. The cost is bounded by the instance limit, not
+ * by the number of voices.
+ */
+bool OpenALSoundSystem::AdmitInstance(unsigned int voice, 
+                                      ISoundResource* resource) {
+    map<ISoundResource*, unsigned int>::iterator itr = 
+        groupIndex.find(resource);
+    if (itr == groupIndex.end()) 
+        return true;
+    unsigned int index = itr->second;
+    InstanceGroup& g = groups[index];
+    // restarting a playing instance does not add one
+    bool member = (voices.group[voice] == (int)index);
+
+    Time now = timer.GetElapsedTime();
+    if (g.started && now < g.lastStart + g.policy.minRetrigger) {
+        stats.playsRejected++;
+        return false;
+    }
+    if (!member && g.policy.maxInstances > 0 &&
+        g.count >= g.policy.maxInstances) {
+        int victim = g.head;
+        if (g.policy.steal == InstancePolicy::REJECT) {
+            stats.playsRejected++;
+            return false;
+        }
+        else if (g.policy.steal == InstancePolicy::STEAL_QUIETEST) {
+            float quietest = Loudness(victim);
+            for (int v = voices.groupNext[victim]; v != -1; 
+                 v = voices.groupNext[v]) {
+                float loudness = Loudness(v);
+                if (loudness < quietest) {
+                    quietest = loudness;
+                    victim = v;
+                }
+            }
+        }
+        StealVoice(victim);
+        stats.playsStolen++;
+    }
+    if (!member) 
+        JoinGroup(voice, index);
+    g.started = true;
+    g.lastStart = now;
+    return true;
+}
+
+void OpenALSoundSystem::JoinGroup(unsigned int voice, unsigned int group) {
+    InstanceGroup& g = groups[group];
+    voices.group[voice] = group;
+    voices.groupPrev[voice] = g.tail;
+    voices.groupNext[voice] = -1;
+    if (g.tail != -1) voices.groupNext[g.tail] = voice;
+    else g.head = voice;
+    g.tail = voice;
+    g.count++;
+}
+
+void OpenALSoundSystem::LeaveGroup(unsigned int voice) {
+    if (voices.group[voice] == -1) return;
+    InstanceGroup& g = groups[voices.group[voice]];
+    int prev = voices.groupPrev[voice];
+    int next = voices.groupNext[voice];
+    if (prev != -1) voices.groupNext[prev] = next;
+    else g.head = next;
+    if (next != -1) voices.groupPrev[next] = prev;
+    else g.tail = prev;
+    g.count--;
+    voices.group[voice] = voices.groupPrev[voice] = voices.groupNext[voice] = -1;
+}
+
+/**
+ * Stop an instance to make room for a new one. Owned sounds get a
+ * FINISHED event, stereo sounds are stopped on both channels.
+ */
+void OpenALSoundSystem::StealVoice(unsigned int voice) {
+    alSourceStop(voices.source[voice]);
+    if (voices.oneShot[voice]) {
+        RecycleOneShot(voice);
+        return;
+    }
+    OpenALMonoSound* mono = voices.mono[voice];
+    if (mono && mono->stereo) {
+        unsigned int right = mono->stereo->right->handle.index;
+        alSourceStop(voices.source[right]);
+        SetSourceState(right, AL_STOPPED);
+    }
+    if (mono)
+        FireEvent(SoundEventArg::FINISHED, mono);
+    SetSourceState(voice, AL_STOPPED);
+}
+
+/**
+ * Approximate loudness of a voice at the listener, using the linear
+ * distance model the context is set up with.
+ */
+float OpenALSoundSystem::Loudness(unsigned int voice) {
+    const float reference = 50.0;
+    float gain = voices.gain[voice] * buses[voices.bus[voice]].effective;
+    float distance = (voices.position[voice] - listenerPos).GetLength();
+    float range = voices.maxDistance[voice] - reference;
+    if (distance <= reference || range <= 0.0) 
+        return gain;
+    if (distance >= voices.maxDistance[voice]) 
+        return 0.0;
+    return gain * (1.0 - (distance - reference) / range);
+}
+
+void OpenALSoundSystem::RefreshState(unsigned int voice) {
     if (!alcContext) return;
-    float pos[3];
-    sound->pos.ToArray(pos);
-    alSourcefv(sound->sourceID, AL_POSITION, pos);
-    ALCenum error;
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("Error updating sound position: "
-		      + Convert::ToString(error));
+    ALuint source = voices.source[voice];
+    alGetSourcei(source, AL_SOURCE_STATE, &voices.state[voice]);
+    alGetSourcei(source, AL_SAMPLE_OFFSET, &voices.sampleOffset[voice]);
+    voices.sampleOffset[voice] = BaseOffset(voice, voices.sampleOffset[voice]);
+    SamplePosition(voice, timer.GetElapsedTime());
+    CheckError("tried to refresh source state but got: ");
+}
+
+void OpenALSoundSystem::SourceStopped(unsigned int voice) {
+    if (voices.oneShot[voice]) {
+        RecycleOneShot(voice);
+        return;
+    }
+    OpenALMonoSound* mono = voices.mono[voice];
+    if (mono) {
+        FireEvent(SoundEventArg::FINISHED, mono);
+        // the channels of a stereo sound stop together, whichever
+        // stop is seen first, and the left fires the stereo event
+        OpenALStereoSound* stereo = mono->stereo;
+        if (stereo) {
+            OpenALMonoSound* other = stereo->left == mono 
+                ? stereo->right : stereo->left;
+            unsigned int sibling = other->handle.index;
+            ALint state = voices.state[sibling];
+            if (state == AL_PLAYING || state == AL_PAUSED) {
+                alSourceStop(voices.source[sibling]);
+                FireEvent(SoundEventArg::FINISHED, other);
+                SetSourceState(sibling, AL_STOPPED);
+            }
+        }
+    } 
+    else if (voices.stream[voice]) {
+        OpenALStreamingSound* sound = voices.stream[voice];
+        if (sound->exhausted) {
+            FireEvent(SoundEventArg::FINISHED, sound);
+        } else {
+            // keep going with the data the refill loop just queued
+            alSourcePlay(voices.source[voice]);
+            voices.state[voice] = AL_PLAYING;
+            FireEvent(SoundEventArg::STARVED, sound);
+            return;
+        }
     }
+    SetSourceState(voice, AL_STOPPED);
+}
+
+/**
+ * Capture the state of all playing voices in one pass.
+ * With AL_SOFT_events the stops are reported by the mixer, so only
+ * the offsets are read here. Otherwise the state is queried as well.
+ * Looping sources are checked for offset wrap-around since OpenAL
+ * does not report loops.
+ */
+void OpenALSoundSystem::UpdateSourceStates() {
+    if (hasEvents) {
+        eventLock.Lock();
+        receivedEvents.swap(pendingEvents);
+        eventLock.Unlock();
+        for (vector<PendingALEvent>::iterator itr = receivedEvents.begin();
+             itr != receivedEvents.end();
+             ++itr) {
+            if (itr->type == AL_EVENT_TYPE_DISCONNECTED_SOFT) {
+                firedEvents.push_back(FiredEvent(NULL, 
+                                                 SoundEventArg(SoundEventArg::DISCONNECTED, NULL)));
+                continue;
+            }
+            // processed buffers are picked up by the refill loop
+            if (itr->type != AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT ||
+                itr->param != AL_STOPPED) 
+                continue;
+
+            map<ALuint, unsigned int>::iterator i = sourceIndex.find(itr->object);
+            if (i == sourceIndex.end() || !voices.active[i->second])
+                continue;
+            // the source may have been restarted since the event was sent
+            ALint state = 0;
+            alGetSourcei(itr->object, AL_SOURCE_STATE, &state);
+            if (state == AL_STOPPED) 
+                SourceStopped(i->second);
+        }
+        receivedEvents.clear();
+    }
+
+    Time now = timer.GetElapsedTime();
+    for (unsigned int i = 0; i < activeVoices.size(); ) {
+        unsigned int voice = activeVoices[i];
+        if (!voices.active[voice]) {
+            voices.listed[voice] = false;
+            activeVoices[i] = activeVoices.back();
+            activeVoices.pop_back();
+            continue;
+        }
+        ++i;
+
+        ALuint source = voices.source[voice];
+        if (!hasEvents) {
+            alGetSourcei(source, AL_SOURCE_STATE, &voices.state[voice]);
+            if (voices.state[voice] == AL_STOPPED) {
+                SourceStopped(voice);
+                continue;
+            }
+        }
+        ALint offset = 0;
+        alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+        offset = BaseOffset(voice, offset);
+        SamplePosition(voice, now);
+        OpenALMonoSound* mono = voices.mono[voice];
+        if (mono && mono->looping && offset < voices.sampleOffset[voice])
+            FireEvent(SoundEventArg::LOOPED, mono);
+        voices.sampleOffset[voice] = offset;
+    }
+    
+    CheckError("Error updating source state: ");
+}
+
+void OpenALSoundSystem::DispatchSourceEvents() {
+    // listeners may destroy sounds, which cancels their pending events
+    for (unsigned int i = 0; i < firedEvents.size(); ++i) {
+        if (firedEvents[i].cancelled) 
+            continue;
+        FiredEvent e = firedEvents[i];
+        if (e.event) 
+            e.event->Notify(e.arg);
+        soundEvent.Notify(e.arg);
+    }
+    firedEvents.clear();
+}
+
+void OpenALSoundSystem::CancelEvents(ISound* sound) {
+    for (vector<FiredEvent>::iterator itr = firedEvents.begin();
+         itr != firedEvents.end();
+         ++itr) {
+        if (itr->arg.sound == sound) 
+            itr->cancelled = true;
+    }
+}
+
+void OpenALSoundSystem::UpdatePosition(unsigned int voice) {
+    if (voices.spatial[voice])
+        emitters.Move(voice, voices.position[voice]);
+    if (!alcContext) return;
+    float pos[3];
+    voices.position[voice].ToArray(pos);
+    alSourcefv(voices.source[voice], AL_POSITION, pos);
+    CheckError("Error updating sound position: ");
 }
 
 unsigned int OpenALSoundSystem::GetDeviceCount() {
@@ -93,58 +623,1870 @@ void OpenALSoundSystem::SetDevice(unsigned int device) {
     this->device = device;
 }
 
+void OpenALSoundSystem::SetContextConfig(ContextConfig config) {
+    contextConfig = config;
+}
+
+OpenALSoundSystem::ContextConfig OpenALSoundSystem::GetContextConfig() {
+    return contextConfig;
+}
+
+Time OpenALSoundSystem::GetDeviceLatency() {
+    return deviceLatency;
+}
+
 ISound *OpenALSoundSystem::CreateSound(IStreamingSoundResourcePtr resource) {
+    return CreateSound(resource, MASTER_BUS);
+}
+
+ISound *OpenALSoundSystem::CreateSound(IStreamingSoundResourcePtr resource,
+                                       BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to create a sound on an unknown mix bus");
     
     OpenALStreamingSound* ssound = new OpenALStreamingSound(resource, this);
+    ssound->handle = voices.Allocate(ssound, NULL, ssound);
+    AssignBus(ssound->handle.index, bus);
 
-    bufferList[resource] = vector<ALuint>();
+    bufferList[resource];
     ssound->e.Attach(*this);
     
     if (alcContext) {
         InitResource(resource);
         InitSound(ssound);
-    } else {
-        streams.push_back(ssound);
     }
 
     return ssound;
     
     
 }
+ISound* OpenALSoundSystem::CreateSound(IStreamingSoundResourcePtr resource,
+                                       Vector<3,float> position,
+                                       BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to create a sound on an unknown mix bus");
+
+    OpenALStreamingSound* ssound = new OpenALStreamingSound(resource, this);
+    ssound->handle = voices.Allocate(ssound, NULL, ssound);
+    ssound->lazy = true;
+    unsigned int voice = ssound->handle.index;
+    AssignBus(voice, bus);
+    voices.position[voice] = position;
+    streamEmitters.Insert(voice, position);
+
+    bufferList[resource];
+    ssound->e.Attach(*this);
+
+    if (alcContext) 
+        InitSound(ssound);
+    return ssound;
+}
+
+void OpenALSoundSystem::SetStreamPosition(ISound* sound, 
+                                          Vector<3,float> position) {
+    OpenALStreamingSound* ssound = dynamic_cast<OpenALStreamingSound*>(sound);
+    if (!ssound || !voices.IsValid(ssound->handle))
+        throw Exception("tried to position a sound that is not a stream of this sound system");
+    unsigned int voice = ssound->handle.index;
+    voices.position[voice] = position;
+    streamEmitters.Move(voice, position);
+    UpdatePosition(voice);
+}
+
+void OpenALSoundSystem::SetPrefetchHorizon(Time horizon) {
+    prefetchHorizon = horizon;
+}
+
+Time OpenALSoundSystem::GetPrefetchHorizon() {
+    return prefetchHorizon;
+}
+
+void OpenALSoundSystem::SetPrefetchLimit(unsigned int streams) {
+    prefetchLimit = streams;
+}
+
+void OpenALSoundSystem::SetStreamReadAhead(Time time) {
+    readAheadTime = time;
+}
+
+Time OpenALSoundSystem::GetStreamReadAhead() {
+    return readAheadTime;
+}
+
+void OpenALSoundSystem::SetStreamWorkers(unsigned int threads) {
+    streamWorkers = threads;
+    // attached streams carry over to the new workers
+    if (streamReader.IsRunning()) {
+        streamReader.Stop();
+        streamReader.Start(streamWorkers);
+    }
+}
+
+void OpenALSoundSystem::SetRefillBudget(Time budget) {
+    refillBudget = budget;
+}
+
+Time OpenALSoundSystem::GetRefillBudget() {
+    return refillBudget;
+}
+
+/**
+ * Attach the current stream of the sound to the reader, when reading
+ * ahead is on. Done as the sound starts playing, so the workers have
+ * filled the ring by its first refill. The stream stays attached
+ * until its voice is released or it moves on to another stream, as
+ * only the reader may touch the resource meanwhile.
+ */
+void OpenALSoundSystem::AttachReadAhead(OpenALStreamingSound* sound) {
+    if (sound->readAhead || !streamReader.IsRunning() || 
+        readAheadTime.AsInt64() <= 0)
+        return;
+    IStreamingSoundResourcePtr resource = sound->resource;
+    double bytes = SampleFormat::Of(resource).FrameSize() * 
+        (double)resource->GetFrequency() * readAheadTime.AsInt64() / 1000000.0;
+    unsigned int capacity = bytes < 64*1024 ? 64*1024 : (unsigned int)bytes;
+    sound->readAhead = streamReader.Attach(resource, capacity, 
+                                           sound->segmentFrames);
+    SetReadAheadLoop(sound);
+    stats.streamsReadAhead++;
+}
+
+// tell the reader how the sound loops, so it reads the next pass ahead
+void OpenALSoundSystem::SetReadAheadLoop(OpenALStreamingSound* sound) {
+    if (sound->readAhead)
+        streamReader.SetLoop(sound->readAhead, sound->looping,
+                             sound->loopStart, sound->loopEnd);
+}
+
+/**
+ * Read the next data of a stream for a refill, through the reader
+ * when the stream is attached.
+ */
+unsigned int OpenALSoundSystem::ReadStream(OpenALStreamingSound* sound, 
+                                           char* buf, unsigned int size) {
+    AttachReadAhead(sound);
+    if (!sound->readAhead)
+        return sound->resource->GetBuffer(size, buf);
+    unsigned int underruns = streamReader.GetUnderruns();
+    unsigned int read = streamReader.Read(sound->readAhead, buf, size);
+    stats.readAheadUnderruns += streamReader.GetUnderruns() - underruns;
+    return read;
+}
+
+/**
+ * Extrapolate the listener along its velocity over the prefetch
+ * horizon, and start decoding the first buffers of the cold streams
+ * that will be in range there. Prefetches not wanted for a whole
+ * horizon are dropped.
+ */
+void OpenALSoundSystem::PredictPrefetches() {
+    Time now = timer.GetElapsedTime();
+    float dt = (now - listenerTime).AsInt64() / 1000000.0;
+    if (dt > 0.0)
+        listenerVelocity = (listenerPos - prevPos) * (1.0 / dt);
+    prevPos = listenerPos;
+    listenerTime = now;
+    if (streamEmitters.Size() == 0 && prefetches.empty())
+        return;
+
+    float horizon = prefetchHorizon.AsInt64() / 1000000.0;
+    Vector<3,float> predicted = listenerPos + listenerVelocity * horizon;
+    streamCandidates.clear();
+    streamEmitters.QueryRadius(predicted, cullRange, streamCandidates);
+    for (unsigned int i = 0; i < streamCandidates.size(); ++i) {
+        unsigned int voice = streamCandidates[i];
+        OpenALStreamingSound* sound = voices.stream[voice];
+        if (sound->warm) 
+            continue;
+        float range = sound->maxdist;
+        if ((voices.position[voice] - predicted).GetLengthSquared() > range * range)
+            continue;
+        IStreamingSoundResource* resource = sound->resource.get();
+        map<IStreamingSoundResource*, Prefetch>::iterator p = prefetches.find(resource);
+        if (p != prefetches.end()) {
+            p->second.wanted = now;
+            continue;
+        }
+        if (prefetches.size() >= prefetchLimit || 
+            !bufferList[sound->resource].empty())
+            continue;
+        DecodeJob* job = new DecodeJob(sound->resource, 200*1024, 2);
+        decodeWorker.Add(job);
+        prefetches.insert(std::make_pair(resource, Prefetch(job, now)));
+        stats.prefetchIssued++;
+    }
+
+    map<IStreamingSoundResource*, Prefetch>::iterator p = prefetches.begin();
+    while (p != prefetches.end()) {
+        map<IStreamingSoundResource*, Prefetch>::iterator current = p++;
+        if (now < current->second.wanted + prefetchHorizon) 
+            continue;
+        // a running job is dropped once it is done
+        if (decodeWorker.GetState(current->second.job) == DecodeJob::RUNNING)
+            continue;
+        DropPrefetch(current->first);
+    }
+}
+
+void OpenALSoundSystem::DropPrefetch(IStreamingSoundResource* resource) {
+    map<IStreamingSoundResource*, Prefetch>::iterator p = prefetches.find(resource);
+    DecodeJob* job = p->second.job;
+    if (!decodeWorker.Cancel(job)) {
+        decodeWorker.Finish(job);
+        // rewind so the stream starts over when it is played
+        job->resource->Unload();
+        job->resource->Load();
+    }
+    delete job;
+    prefetches.erase(p);
+    stats.prefetchDropped++;
+}
+
+/**
+ * Give a positional stream its first buffers, from a finished
+ * prefetch when there is one and by decoding them now otherwise,
+ * and start reading the rest ahead.
+ */
+void OpenALSoundSystem::WarmStream(OpenALStreamingSound* sound) {
+    if (sound->warm) {
+        AttachReadAhead(sound);
+        return;
+    }
+    IStreamingSoundResourcePtr resource = sound->resource;
+    if (bufferList[resource].empty()) {
+        map<IStreamingSoundResource*, Prefetch>::iterator p = 
+            prefetches.find(resource.get());
+        DecodeJob* job = (p != prefetches.end()) ? p->second.job : NULL;
+        if (job && decodeWorker.Cancel(job)) {
+            delete job;
+            prefetches.erase(p);
+            job = NULL;
+        }
+        if (job) {
+            if (decodeWorker.GetState(job) == DecodeJob::DONE) 
+                stats.prefetchHits++;
+            else
+                stats.prefetchMisses++;
+            decodeWorker.Finish(job);
+            InitResource(resource, job);
+            delete job;
+            prefetches.erase(p);
+        } else {
+            stats.prefetchMisses++;
+            InitResource(resource);
+        }
+    }
+    QueueStreamBuffers(sound);
+    AttachReadAhead(sound);
+}
+
 ISound* OpenALSoundSystem::CreateSound(ISoundResourcePtr resource) {
-    SoundFormat format = resource->GetFormat();
+    return CreateSound(resource, MASTER_BUS);
+}
+
+ISound* OpenALSoundSystem::CreateSound(ISoundResourcePtr resource, BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to create a sound on an unknown mix bus");
+    SampleFormat format = SampleFormat::Of(resource);
     ISound* sound = NULL;
-    if (format == MONO) {
+    // stereo is split into two positional sources, other layouts
+    // play from one source in their own channel format
+    if (format.channels != 2) {
         OpenALMonoSound* msound = new OpenALMonoSound(resource, this);
+        msound->handle = voices.Allocate(msound, msound, NULL);
+        AssignBus(msound->handle.index, bus);
+        SetSpatial(msound->handle.index, format.channels == 1);
         sound = msound;
         buffers[resource] = 0;
         msound->e.Attach(*this);
         if (alcContext) {
-            InitResource(resource);
+            InitResource(resource, bus);
             InitSound(msound);
         }
-        else {
-            monos.push_back(msound);
-        }
-    } else if (format == STEREO) {
+    } else {
         OpenALStereoSound* ssound = new OpenALStereoSound(resource, this);
+        ssound->left->handle = voices.Allocate(ssound, ssound->left, NULL);
+        ssound->right->handle = voices.Allocate(ssound, ssound->right, NULL);
+        AssignBus(ssound->left->handle.index, bus);
+        AssignBus(ssound->right->handle.index, bus);
         sound = ssound;
         buffers[ssound->left->resource] = 0;
         buffers[ssound->right->resource] = 0;
+        // the split channels are compressed like the resource
+        map<ISoundResource*, bool>::iterator c = compression.find(resource.get());
+        if (c != compression.end()) {
+            compression[ssound->left->resource.get()] = c->second;
+            compression[ssound->right->resource.get()] = c->second;
+        }
         ssound->e.Attach(*this);
         if (alcContext) {
-            InitResource(ssound->left->resource);
-            InitResource(ssound->right->resource);
+            InitResource(ssound->left->resource, bus);
+            InitResource(ssound->right->resource, bus);
             InitSound(ssound->left);
             InitSound(ssound->right);
         }
-        else {	
-            monos.push_back(ssound->left);
-            monos.push_back(ssound->right);
+    }
+    return sound;
+}
+
+/**
+ * Stop the voice, delete its source and drop its buffer references.
+ * Buffers no longer referenced by any voice are deleted as well.
+ */
+void OpenALSoundSystem::ReleaseVoice(SoundHandle handle) {
+    unsigned int voice = handle.index;
+    ALuint source = voices.source[voice];
+    if (alcContext && source) {
+        alSourceStop(source);
+        alSourcei(source, AL_BUFFER, 0);
+        alDeleteSources(1, &source);
+        sourceIndex.erase(source);
+        if (voices.pad[voice]) {
+            alDeleteBuffers(1, &voices.pad[voice]);
+            voices.pad[voice] = 0;
+            voices.padLength[voice] = 0.0;
+        }
+        voices.lodNext[voice] = -1;
+
+        vector<ALuint> released;
+        if (voices.mono[voice]) 
+            released.push_back(voices.buffer[voice]);
+        else if (voices.stream[voice])
+            released = voices.stream[voice]->bufferIDs;
+        for (vector<ALuint>::iterator itr = released.begin();
+             itr != released.end();
+             ++itr) {
+            ALuint buffer = *itr;
+            if (--bufferRefs[buffer] > 0) 
+                continue;
+            bufferRefs.erase(buffer);
+            DeleteLODSet(buffer);
+            alDeleteBuffers(1, &buffer);
+            ForgetBuffer(buffer);
+            for (map<IStreamingSoundResourcePtr, vector<ALuint> >::iterator b = bufferList.begin();
+                 b != bufferList.end(); ++b) {
+                if (!b->second.empty() && b->second[0] == buffer) { 
+                    bufferList.erase(b); 
+                    break; 
+                }
+            }
+        }
+        CheckError("Error releasing sound: ");
+    }
+    OpenALStreamingSound* stream = voices.stream[voice];
+    if (stream && stream->readAhead) {
+        streamReader.Detach(stream->readAhead);
+        stream->readAhead = NULL;
+    }
+    SetSourceState(voice, AL_STOPPED);
+    SetSpatial(voice, false);
+    streamEmitters.Remove(voice);
+    RemoveFromBus(voice);
+    voices.Release(handle);
+}
+
+void OpenALSoundSystem::DestroySound(ISound* sound) {
+    if (sound == NULL) return;
+    SoundHandle handle = GetHandle(sound);
+    if (!voices.IsValid(handle))
+        throw Exception("tried to destroy a sound that does not belong to this sound system");
+    // a channel of a stereo sound is owned by it, and takes the whole
+    // sound with it
+    sound = voices.owner[handle.index];
+
+    // drop actions queued before the context was created
+    queue<ALMonoEventArg> monoQueue;
+    for (; !monoActions.empty(); monoActions.pop()) {
+        ISound* owner = voices.owner[monoActions.front().sound->handle.index];
+        if (owner != sound) monoQueue.push(monoActions.front());
+    }
+    monoActions = monoQueue;
+    queue<ALStereoEventArg> stereoQueue;
+    for (; !stereoActions.empty(); stereoActions.pop()) {
+        if (stereoActions.front().sound != sound) 
+            stereoQueue.push(stereoActions.front());
+    }
+    stereoActions = stereoQueue;
+    queue<ALStreamEventArg> streamQueue;
+    for (; !streamActions.empty(); streamActions.pop()) {
+        if (streamActions.front().sound != sound) 
+            streamQueue.push(streamActions.front());
+    }
+    streamActions = streamQueue;
+
+    CancelEvents(sound);
+
+    if (voices.mono[handle.index] && voices.mono[handle.index]->stereo) {
+        OpenALStereoSound* stereo = voices.mono[handle.index]->stereo;
+        CancelEvents(stereo->left);
+        CancelEvents(stereo->right);
+        ReleaseVoice(stereo->left->handle);
+        ReleaseVoice(stereo->right->handle);
+    } 
+    else
+        ReleaseVoice(handle);
+    delete sound;
+}
+
+void OpenALSoundSystem::SetOneShotVoices(unsigned int count) {
+    oneShotVoices = count;
+    if (alcContext) 
+        GrowOneShotPool(count);
+}
+
+unsigned int OpenALSoundSystem::GetOneShotVoices() {
+    return oneShotVoices;
+}
+
+/**
+ * Create the sources used by PlayOneShot up front, so playing one
+ * does not allocate. The pool only grows.
+ */
+void OpenALSoundSystem::GrowOneShotPool(unsigned int count) {
+    while (oneShotPool.size() < count) {
+        ALuint source;
+        alGenSources(1, &source);
+        // running out of sources is not fatal, we just get fewer
+        ALenum error = alGetError();
+        if (error != AL_NO_ERROR) {
+            logger.warning << "Only got " << oneShotPool.size() 
+                           << " one-shot voices: " << error << logger.end;
+            break;
+        }
+        SoundHandle handle = voices.Allocate(NULL, NULL, NULL);
+        unsigned int voice = handle.index;
+        voices.oneShot[voice] = true;
+        voices.source[voice] = source;
+        voices.gain[voice] = 1.0;
+        AssignBus(voice, MASTER_BUS);
+        SetSpatial(voice, true);
+        sourceIndex[source] = voice;
+        alSourcef(source, AL_ROLLOFF_FACTOR, 1.0f);
+        alSourcef(source, AL_REFERENCE_DISTANCE, 50.0f);
+        alSourcef(source, AL_MAX_DISTANCE, 1000.0f);
+        oneShotPool.push_back(voice);
+        freeOneShots.push_back(voice);
+    }
+    freeOneShots.reserve(oneShotPool.size());
+    ReserveVoiceLists();
+    CheckError("Error setting up one-shot voices: ");
+}
+
+/**
+ * Size the lists a play adds a voice to for every voice there is,
+ * so plays of pooled one-shots do not allocate.
+ */
+void OpenALSoundSystem::ReserveVoiceLists() {
+    unsigned int size = voices.Size();
+    activeVoices.reserve(size);
+    // a voice is listed at most once per cull pass
+    cullCheck.reserve(size);
+    emitters.Reserve(size);
+    for (unsigned int i = 0; i < buses.size(); ++i)
+        buses[i].voices.reserve(size);
+}
+
+bool OpenALSoundSystem::PlayOneShot(ISoundResourcePtr resource, 
+                                    Vector<3,float> position,
+                                    float gain, float pitch) {
+    return PlayOneShot(resource, position, MASTER_BUS, gain, pitch);
+}
+
+bool OpenALSoundSystem::PlayOneShot(ISoundResourcePtr resource, 
+                                    Vector<3,float> position,
+                                    BusID bus, float gain, float pitch) {
+    if (bus >= buses.size())
+        throw Exception("tried to play a one-shot on an unknown mix bus");
+    if (!alcContext) 
+        return false;
+    if (freeOneShots.empty()) {
+        stats.oneShotsDropped++;
+        return false;
+    }
+
+    // the buffer is uploaded on first use and kept for the next ones
+    map<ISoundResourcePtr, ALuint>::iterator b = buffers.find(resource);
+    if (b == buffers.end() || b->second == 0) {
+        buffers[resource] = 0;
+        InitResource(resource, bus);
+        b = buffers.find(resource);
+    }
+    ALuint buffer = b->second;
+
+    unsigned int voice = freeOneShots.back();
+    freeOneShots.pop_back();
+    voices.gain[voice] = gain;
+    voices.position[voice] = position;
+    emitters.Move(voice, position);
+    if (!AdmitInstance(voice, resource.get())) {
+        freeOneShots.push_back(voice);
+        return false;
+    }
+    ALuint source = voices.source[voice];
+    voices.buffer[voice] = buffer;
+    // only the first play of a buffer inserts its count
+    map<ALuint, unsigned int>::iterator r = bufferRefs.find(buffer);
+    if (r != bufferRefs.end()) r->second++;
+    else bufferRefs[buffer] = 1;
+    AssignBus(voice, bus);
+
+    float pos[3];
+    position.ToArray(pos);
+    alSourcei(source, AL_BUFFER, StartLevel(voice));
+    ApplyGain(voice);
+    alSourcef(source, AL_PITCH, pitch);
+    alSourcefv(source, AL_POSITION, pos);
+    alSourcePlay(source);
+    CheckError("Error playing one-shot: ");
+    SetSourceState(voice, AL_PLAYING);
+    stats.oneShots++;
+    return true;
+}
+
+/**
+ * Return a finished one-shot voice to the pool. The buffer stays in
+ * the cache even when no voice references it any more.
+ */
+void OpenALSoundSystem::RecycleOneShot(unsigned int voice) {
+    ALuint buffer = voices.buffer[voice];
+    alSourcei(voices.source[voice], AL_BUFFER, 0);
+    map<ALuint, unsigned int>::iterator r = bufferRefs.find(buffer);
+    if (r != bufferRefs.end() && r->second > 0) 
+        r->second--;
+    voices.buffer[voice] = 0;
+    voices.lod[voice] = 0;
+    SetSourceState(voice, AL_STOPPED);
+    freeOneShots.push_back(voice);
+}
+
+OpenALSoundSystem::BusID OpenALSoundSystem::CreateBus(string name, 
+                                                     BusID parent) {
+    if (parent >= buses.size())
+        throw Exception("tried to create a mix bus under an unknown bus");
+    if (busNames.find(name) != busNames.end())
+        throw Exception("mix bus " + name + " already exists");
+    BusID bus = buses.size();
+    buses.push_back(MixBus(name, parent, buses[parent].effective,
+                           buses[parent].compress));
+    buses[parent].children.push_back(bus);
+    buses[bus].voices.reserve(voices.Size());
+    busNames[name] = bus;
+    return bus;
+}
+
+OpenALSoundSystem::BusID OpenALSoundSystem::GetBus(string name) {
+    map<string, BusID>::iterator itr = busNames.find(name);
+    if (itr == busNames.end())
+        throw Exception("unknown mix bus " + name);
+    return itr->second;
+}
+
+void OpenALSoundSystem::SetBusGain(BusID bus, float gain) {
+    if (bus >= buses.size())
+        throw Exception("tried to set the gain of an unknown mix bus");
+    if (gain < 0.0) 
+        gain = 0.0;
+    buses[bus].gain = gain;
+    UpdateBusGain(bus);
+    CheckError("tried to set bus gain but got: ");
+}
+
+float OpenALSoundSystem::GetBusGain(BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to get the gain of an unknown mix bus");
+    return buses[bus].gain;
+}
+
+/**
+ * Pause the playing voices on the bus and its children. Only those
+ * are started again by ResumeBus.
+ */
+void OpenALSoundSystem::PauseBus(BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to pause an unknown mix bus");
+    if (!alcContext) 
+        return;
+    busVoices.clear();
+    busSources.clear();
+    CollectBusVoices(bus, busVoices);
+    vector<unsigned int>::iterator itr = busVoices.begin();
+    while (itr != busVoices.end()) {
+        if (voices.state[*itr] == AL_PLAYING) {
+            busSources.push_back(voices.source[*itr]);
+            ++itr;
+        }
+        else itr = busVoices.erase(itr);
+    }
+    if (busSources.empty()) 
+        return;
+    alSourcePausev(busSources.size(), &busSources[0]);
+    for (itr = busVoices.begin(); itr != busVoices.end(); ++itr) {
+        SetSourceState(*itr, AL_PAUSED);
+        voices.busPaused[*itr] = true;
+    }
+    CheckError("Error pausing bus: ");
+}
+
+void OpenALSoundSystem::ResumeBus(BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to resume an unknown mix bus");
+    if (!alcContext) 
+        return;
+    busVoices.clear();
+    busSources.clear();
+    CollectBusVoices(bus, busVoices);
+    vector<unsigned int>::iterator itr = busVoices.begin();
+    while (itr != busVoices.end()) {
+        bool paused = voices.busPaused[*itr] && 
+            voices.state[*itr] == AL_PAUSED;
+        voices.busPaused[*itr] = false;
+        if (paused) {
+            busSources.push_back(voices.source[*itr]);
+            ++itr;
+        }
+        else itr = busVoices.erase(itr);
+    }
+    if (busSources.empty()) 
+        return;
+    alSourcePlayv(busSources.size(), &busSources[0]);
+    for (itr = busVoices.begin(); itr != busVoices.end(); ++itr)
+        SetSourceState(*itr, AL_PLAYING);
+    CheckError("Error resuming bus: ");
+}
+
+void OpenALSoundSystem::StopBus(BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to stop an unknown mix bus");
+    if (!alcContext) 
+        return;
+    busVoices.clear();
+    busSources.clear();
+    CollectBusVoices(bus, busVoices);
+    vector<unsigned int>::iterator itr = busVoices.begin();
+    while (itr != busVoices.end()) {
+        voices.busPaused[*itr] = false;
+        if (voices.state[*itr] == AL_PLAYING || 
+            voices.state[*itr] == AL_PAUSED) {
+            busSources.push_back(voices.source[*itr]);
+            ++itr;
+        }
+        else itr = busVoices.erase(itr);
+    }
+    if (busSources.empty()) 
+        return;
+    alSourceStopv(busSources.size(), &busSources[0]);
+    for (itr = busVoices.begin(); itr != busVoices.end(); ++itr) {
+        if (voices.oneShot[*itr]) 
+            RecycleOneShot(*itr);
+        else
+            SetSourceState(*itr, AL_STOPPED);
+    }
+    CheckError("Error stopping bus: ");
+}
+
+void OpenALSoundSystem::AssignBus(unsigned int voice, BusID bus) {
+    if (voices.busSlot[voice] != -1 && voices.bus[voice] == bus) 
+        return;
+    RemoveFromBus(voice);
+    if (voices.active[voice]) {
+        CountPlaying(voices.bus[voice], -1);
+        CountPlaying(bus, 1);
+    }
+    voices.bus[voice] = bus;
+    voices.busSlot[voice] = buses[bus].voices.size();
+    buses[bus].voices.push_back(voice);
+}
+
+void OpenALSoundSystem::RemoveFromBus(unsigned int voice) {
+    int slot = voices.busSlot[voice];
+    if (slot == -1) 
+        return;
+    vector<unsigned int>& list = buses[voices.bus[voice]].voices;
+    unsigned int last = list.back();
+    list[slot] = last;
+    voices.busSlot[last] = slot;
+    list.pop_back();
+    voices.busSlot[voice] = -1;
+}
+
+void OpenALSoundSystem::CollectBusVoices(BusID bus, vector<unsigned int>& out) {
+    MixBus& b = buses[bus];
+    out.insert(out.end(), b.voices.begin(), b.voices.end());
+    for (vector<BusID>::iterator itr = b.children.begin();
+         itr != b.children.end();
+         ++itr)
+        CollectBusVoices(*itr, out);
+}
+
+/**
+ * Recompute the effective gain of the bus and its children, and
+ * push it to their sources.
+ */
+void OpenALSoundSystem::UpdateBusGain(BusID bus) {
+    MixBus& b = buses[bus];
+    b.effective = b.gain * b.duck;
+    if (bus != MASTER_BUS) 
+        b.effective *= buses[b.parent].effective;
+    for (vector<unsigned int>::iterator itr = b.voices.begin();
+         itr != b.voices.end();
+         ++itr)
+        ApplyGain(*itr);
+    for (vector<BusID>::iterator itr = b.children.begin();
+         itr != b.children.end();
+         ++itr)
+        UpdateBusGain(*itr);
+}
+
+void OpenALSoundSystem::CountPlaying(BusID bus, int delta) {
+    for (;;) {
+        buses[bus].playing += delta;
+        if (bus == MASTER_BUS) break;
+        bus = buses[bus].parent;
+    }
+}
+
+void OpenALSoundSystem::AddDuckingRule(BusID trigger, BusID target, 
+                                       float attenuation, 
+                                       Time attack, Time release) {
+    if (trigger >= buses.size() || target >= buses.size())
+        throw Exception("tried to duck an unknown mix bus");
+    if (attenuation < 0.0) attenuation = 0.0;
+    if (attenuation > 1.0) attenuation = 1.0;
+    duckingRules.push_back(new DuckingRule(this, trigger, target, 
+                                           attenuation, attack, release));
+}
+
+void OpenALSoundSystem::ClearDuckingRules() {
+    for (vector<DuckingRule*>::iterator itr = duckingRules.begin();
+         itr != duckingRules.end();
+         ++itr) {
+        timedExecutioner.Cancel(*itr);
+        delete *itr;
+    }
+    duckingRules.clear();
+    for (unsigned int bus = 0; bus < buses.size(); ++bus)
+        buses[bus].duck = 1.0;
+    UpdateBusGain(MASTER_BUS);
+}
+
+/**
+ * Start a ramp for each rule whose trigger bus started or stopped
+ * playing since the last update. The ramp time is scaled by how far
+ * the level has to move.
+ */
+void OpenALSoundSystem::EvaluateDucking() {
+    for (vector<DuckingRule*>::iterator itr = duckingRules.begin();
+         itr != duckingRules.end();
+         ++itr) {
+        DuckingRule* rule = *itr;
+        bool triggered = buses[rule->trigger].playing > 0;
+        if (triggered == rule->triggered) 
+            continue;
+        rule->triggered = triggered;
+        timedExecutioner.Cancel(rule);
+        float to = triggered ? 1.0 : 0.0;
+        float distance = triggered ? 1.0 - rule->level : rule->level;
+        Time ramp = triggered ? rule->attack : rule->release;
+        ramp = Time((uint64_t)(ramp.AsInt64() * distance));
+        timedExecutioner.Add(rule, rule->level, to, ramp, false);
+    }
+}
+
+void OpenALSoundSystem::UpdateDucking(BusID bus) {
+    float duck = 1.0;
+    for (vector<DuckingRule*>::iterator itr = duckingRules.begin();
+         itr != duckingRules.end();
+         ++itr) {
+        DuckingRule* rule = *itr;
+        if (rule->target == bus)
+            duck *= 1.0 - rule->level * (1.0 - rule->attenuation);
+    }
+    buses[bus].duck = duck;
+    UpdateBusGain(bus);
+}
+
+void OpenALSoundSystem::ApplyGain(unsigned int voice) {
+    ALuint source = voices.source[voice];
+    if (!alcContext || !source) 
+        return;
+    alSourcef(source, AL_GAIN, 
+              voices.gain[voice] * buses[voices.bus[voice]].effective);
+}
+
+void OpenALSoundSystem::SetSpatial(unsigned int voice, bool spatial) {
+    if (spatial == (bool)voices.spatial[voice]) 
+        return;
+    voices.spatial[voice] = spatial;
+    if (spatial) 
+        emitters.Insert(voice, voices.position[voice]);
+    else
+        emitters.Remove(voice);
+}
+
+void OpenALSoundSystem::SetDistanceCulling(bool enabled) {
+    culling = enabled;
+    if (enabled) 
+        return;
+    // nothing is checked while culling is off, and voices listed
+    // before are listed again by their next play
+    cullCheck.clear();
+    cullFrame++;
+    if (!alcContext)
+        return;
+    for (unsigned int voice = 0; voice < voices.Size(); ++voice)
+        if (voices.culled[voice]) 
+            UncullVoice(voice);
+    cullExpiry.clear();
+    CheckError("Error resuming culled sounds: ");
+}
+
+bool OpenALSoundSystem::GetDistanceCulling() {
+    return culling;
+}
+
+void OpenALSoundSystem::SetCullingCellSize(float size) {
+    if (size <= 0.0)
+        throw Exception("culling cell size must be positive");
+    emitters.SetCellSize(size);
+}
+
+void OpenALSoundSystem::QueryRadius(Vector<3,float> center, float radius, 
+                                    vector<SoundHandle>& out) {
+    cullCandidates.clear();
+    emitters.QueryRadius(center, radius, cullCandidates);
+    for (unsigned int i = 0; i < cullCandidates.size(); ++i) {
+        unsigned int voice = cullCandidates[i];
+        // one-shots are not sounds
+        if (voices.owner[voice])
+            out.push_back(SoundHandle(voice, voices.generation[voice]));
+    }
+}
+
+void OpenALSoundSystem::QueryNearest(Vector<3,float> center, 
+                                     unsigned int count, float radius,
+                                     vector<SoundHandle>& out) {
+    cullCandidates.clear();
+    emitters.QueryNearest(center, count + oneShotPool.size(), radius, 
+                          cullCandidates);
+    for (unsigned int i = 0; i < cullCandidates.size() && count > 0; ++i) {
+        unsigned int voice = cullCandidates[i];
+        if (!voices.owner[voice]) continue;
+        out.push_back(SoundHandle(voice, voices.generation[voice]));
+        count--;
+    }
+}
+
+/**
+ * Pause the voices that left the range of the listener and resume
+ * the ones that came back. Only voices found around the listener and
+ * the ones that were audible or started since the last pass are
+ * looked at, so the cost follows the number of audible voices.
+ */
+void OpenALSoundSystem::CullVoices() {
+    if (!culling && !lodEnabled) 
+        return;
+    cullFrame++;
+    cullCandidates.clear();
+    emitters.QueryRadius(listenerPos, cullRange, cullCandidates);
+    for (unsigned int i = 0; i < cullCandidates.size(); ++i) {
+        unsigned int voice = cullCandidates[i];
+        float range = voices.maxDistance[voice];
+        float distance = (voices.position[voice] - listenerPos).GetLengthSquared();
+        if (distance > range * range) 
+            continue;
+        voices.audibleFrame[voice] = cullFrame;
+        if (voices.culled[voice]) 
+            UncullVoice(voice);
+        if (lodEnabled && voices.active[voice])
+            UpdateLevelOfDetail(voice, distance);
+    }
+    if (!culling) {
+        CheckError("Error updating detail levels: ");
+        return;
+    }
+    for (unsigned int i = 0; i < cullCheck.size(); ++i) {
+        unsigned int voice = cullCheck[i];
+        if (voices.audibleFrame[voice] != cullFrame && 
+            voices.active[voice] && voices.spatial[voice])
+            CullVoice(voice);
+    }
+    cullCheck.clear();
+    for (unsigned int i = 0; i < cullCandidates.size(); ++i) {
+        unsigned int voice = cullCandidates[i];
+        if (voices.active[voice]) {
+            voices.checkFrame[voice] = cullFrame + 1;
+            cullCheck.push_back(voice);
+        }
+    }
+    ExpireCulledVoices();
+    CheckError("Error culling sounds: ");
+}
+
+void OpenALSoundSystem::CullVoice(unsigned int voice) {
+    ALuint source = voices.source[voice];
+    alSourcePause(source);
+    alGetSourcef(source, AL_SEC_OFFSET, &voices.secOffset[voice]);
+    CountPlaying(voices.bus[voice], -1);
+    voices.active[voice] = false;
+    voices.culled[voice] = true;
+    voices.cullTime[voice] = timer.GetElapsedTime();
+    voices.length[voice] = BufferLength(voices.buffer[voice]);
+    OpenALMonoSound* mono = voices.mono[voice];
+    if (!mono || !mono->looping)
+        cullExpiry.push_back(voice);
+    stats.voicesCulled++;
+}
+
+/**
+ * Resume a culled voice at the offset it would have reached, or
+ * finish it if it would have ended meanwhile.
+ */
+void OpenALSoundSystem::UncullVoice(unsigned int voice) {
+    ALuint source = voices.source[voice];
+    Time elapsed = timer.GetElapsedTime() - voices.cullTime[voice];
+    float offset = voices.secOffset[voice] + elapsed.AsInt64() / 1000000.0;
+    float length = voices.length[voice];
+    OpenALMonoSound* mono = voices.mono[voice];
+    voices.culled[voice] = false;
+    if (offset >= length && !(mono && mono->looping)) {
+        alSourceStop(source);
+        SourceStopped(voice);
+        return;
+    }
+    if (length > 0.0) 
+        offset = fmod(offset, length);
+    alSourcef(source, AL_SEC_OFFSET, offset);
+    alSourcePlay(source);
+    SetSourceState(voice, AL_PLAYING);
+}
+
+void OpenALSoundSystem::ExpireCulledVoices() {
+    Time now = timer.GetElapsedTime();
+    for (unsigned int i = 0; i < cullExpiry.size(); ) {
+        unsigned int voice = cullExpiry[i];
+        if (voices.culled[voice]) {
+            float offset = voices.secOffset[voice] + 
+                (now - voices.cullTime[voice]).AsInt64() / 1000000.0;
+            if (offset < voices.length[voice]) {
+                ++i;
+                continue;
+            }
+            voices.culled[voice] = false;
+            alSourceStop(voices.source[voice]);
+            SourceStopped(voice);
+        }
+        cullExpiry[i] = cullExpiry.back();
+        cullExpiry.pop_back();
+    }
+}
+
+void OpenALSoundSystem::SetResampleToDevice(bool enabled, 
+                                            string cacheDirectory) {
+    resampleToDevice = enabled;
+    conversionCache.SetDirectory(cacheDirectory);
+}
+
+bool OpenALSoundSystem::GetResampleToDevice() {
+    return resampleToDevice;
+}
+
+unsigned int OpenALSoundSystem::GetDeviceFrequency() {
+    return deviceFrequency;
+}
+
+/**
+ * Resample 8 or 16 bit PCM to 16 bit at the device rate, so the
+ * mixer does not have to. Results are looked up in and added to the
+ * conversion cache by a hash of the data and the rates.
+ */
+void OpenALSoundSystem::ConvertToDeviceRate(const char* data, unsigned int size,
+                                            unsigned int bits, unsigned int channels,
+                                            unsigned int frequency, 
+                                            vector<char>& out) {
+    if (bits != 8 && bits != 16) 
+        return;
+    uint64_t key = ConversionCache::HashData(data, size);
+    key = ConversionCache::Hash(bits, key);
+    key = ConversionCache::Hash(channels, key);
+    key = ConversionCache::Hash(frequency, key);
+    key = ConversionCache::Hash(deviceFrequency, key);
+    if (conversionCache.Load(key, out)) {
+        stats.resampleCacheHits++;
+        return;
+    }
+
+    vector<short> wide;
+    const short* samples = (const short*)data;
+    unsigned int count = size / (bits / 8);
+    if (bits == 8 && count) {
+        wide.resize(count);
+        SampleKernels::Converter(SampleFormat::INT8, SampleFormat::INT16)
+            (data, (char*)&wide[0], count);
+        samples = &wide[0];
+    }
+    Resampler resampler(frequency, deviceFrequency);
+    vector<short> resampled;
+    resampler.Process(samples, count / channels, channels, resampled);
+    out.resize(resampled.size() * sizeof(short));
+    if (!out.empty())
+        memcpy(&out[0], &resampled[0], out.size());
+    conversionCache.Store(key, out);
+    stats.resampled++;
+}
+
+/**
+ * Look up the buffer formats of the current context. The float and
+ * multichannel formats are not in the core headers, so they are
+ * fetched by name.
+ */
+void OpenALSoundSystem::InitFormats() {
+    memset(alFormats, 0, sizeof(alFormats));
+    alFormats[1][SampleFormat::INT8] = AL_FORMAT_MONO8;
+    alFormats[1][SampleFormat::INT16] = AL_FORMAT_MONO16;
+    alFormats[2][SampleFormat::INT8] = AL_FORMAT_STEREO8;
+    alFormats[2][SampleFormat::INT16] = AL_FORMAT_STEREO16;
+    if (alIsExtensionPresent("AL_EXT_FLOAT32")) {
+        alFormats[1][SampleFormat::FLOAT32] = alGetEnumValue("AL_FORMAT_MONO_FLOAT32");
+        alFormats[2][SampleFormat::FLOAT32] = alGetEnumValue("AL_FORMAT_STEREO_FLOAT32");
+    }
+    if (alIsExtensionPresent("AL_EXT_MCFORMATS")) {
+        const char* layouts[] = { "QUAD", "51CHN", "61CHN", "71CHN" };
+        const unsigned int channels[] = { 4, 6, 7, 8 };
+        const char* types[] = { "8", "16", "32" };
+        for (unsigned int i = 0; i < 4; ++i) {
+            for (unsigned int t = 0; t < 3; ++t) {
+                string name = string("AL_FORMAT_") + layouts[i] + types[t];
+                alFormats[channels[i]][t] = alGetEnumValue(name.c_str());
+            }
+        }
+    }
+    memset(ima4Formats, 0, sizeof(ima4Formats));
+    if (alIsExtensionPresent("AL_EXT_IMA4")) {
+        ima4Formats[1] = alGetEnumValue("AL_FORMAT_MONO_IMA4");
+        ima4Formats[2] = alGetEnumValue("AL_FORMAT_STEREO_IMA4");
+    }
+    // a name the implementation does not know is an error, not a format
+    alGetError();
+    logger.info << "OpenAL float formats: " 
+                << (alFormats[1][SampleFormat::FLOAT32] ? "yes" : "no")
+                << ", multichannel formats: " 
+                << (alFormats[6][SampleFormat::INT16] ? "yes" : "no") << logger.end;
+}
+
+bool OpenALSoundSystem::IsNativeFormat(SampleFormat format) {
+    if (format.channels > SampleFormat::MAX_CHANNELS)
+        return false;
+    return alFormats[format.channels][format.type] != 0;
+}
+
+/**
+ * The AL format to upload data of the given format with. When the
+ * device has no such format, upload is set to the nearest one it
+ * has: float becomes 16 bit and more than two channels stereo.
+ */
+ALenum OpenALSoundSystem::ResolveFormat(SampleFormat format, 
+                                        SampleFormat& upload) {
+    if (format.channels == 0 || format.channels > SampleFormat::MAX_CHANNELS)
+        throw Exception("unsupported number of channels");
+    upload = format;
+    if (alFormats[upload.channels][upload.type])
+        return alFormats[upload.channels][upload.type];
+    if (upload.type == SampleFormat::FLOAT32) {
+        upload.type = SampleFormat::INT16;
+        if (alFormats[upload.channels][upload.type])
+            return alFormats[upload.channels][upload.type];
+    }
+    if (upload.channels > 2) {
+        upload.channels = 2;
+        if (alFormats[2][format.type]) 
+            upload.type = format.type;
+        if (alFormats[upload.channels][upload.type])
+            return alFormats[upload.channels][upload.type];
+    }
+    throw Exception("unsupported sample format");
+}
+
+/**
+ * Fill the buffer with data of the given format, converting it on
+ * the CPU only when the device lacks the format.
+ */
+void OpenALSoundSystem::BufferData(ALuint buffer, SampleFormat format, 
+                                   const char* data, unsigned int size,
+                                   unsigned int frequency) {
+    SampleFormat upload;
+    ALenum alFormat = ResolveFormat(format, upload);
+    if (upload != format) {
+        ConvertSamples(data, size, format, upload, formatScratch);
+        data = formatScratch.empty() ? NULL : &formatScratch[0];
+        size = formatScratch.size();
+    }
+    alBufferData(buffer, alFormat, data, size, frequency);
+}
+
+void OpenALSoundSystem::SetCompression(ISoundResourcePtr resource, 
+                                       bool compressed) {
+    compression[resource.get()] = compressed;
+}
+
+void OpenALSoundSystem::SetBusCompression(BusID bus, bool compressed) {
+    if (bus >= buses.size())
+        throw Exception("tried to set compression of an unknown mix bus");
+    buses[bus].compress = compressed;
+}
+
+bool OpenALSoundSystem::IsCompressionSupported() {
+    return ima4Formats[1] != 0;
+}
+
+/**
+ * Encode mono or stereo data to IMA ADPCM, widening it to 16 bit
+ * first, the encoder's input format. The result is looked up in and
+ * added to the conversion cache.
+ */
+void OpenALSoundSystem::EncodeAdpcm(SampleFormat format, const char* data,
+                                    unsigned int size, vector<char>& encoded) {
+    unsigned int samples = size / format.BytesPerSample();
+    vector<char> pcm;
+    if (format.type != SampleFormat::INT16) {
+        pcm.resize(samples * sizeof(short));
+        if (samples)
+            SampleKernels::Converter(format.type, SampleFormat::INT16)
+                (data, &pcm[0], samples);
+        data = samples ? &pcm[0] : NULL;
+    }
+
+    // tag the key so it never matches a resampled entry
+    uint64_t key = ConversionCache::HashData(data, samples * sizeof(short));
+    key = ConversionCache::Hash(0x494d4134ULL, key); // "IMA4"
+    key = ConversionCache::Hash(format.channels, key);
+    if (!conversionCache.Load(key, encoded)) {
+        AdpcmEncoder::Encode((const short*)data, samples / format.channels,
+                             format.channels, encoded);
+        conversionCache.Store(key, encoded);
+    }
+}
+
+/**
+ * Encode the data to IMA ADPCM and upload it, or return false when
+ * the device cannot take it so the caller uploads PCM.
+ */
+bool OpenALSoundSystem::UploadCompressed(ALuint buffer, SampleFormat format,
+                                         const char* data, unsigned int size,
+                                         unsigned int frequency) {
+    if (format.channels > 2 || !ima4Formats[format.channels])
+        return false;
+    vector<char> encoded;
+    EncodeAdpcm(format, data, size, encoded);
+    unsigned int samples = size / format.BytesPerSample();
+    if (encoded.empty())
+        return false;
+    alBufferData(buffer, ima4Formats[format.channels], 
+                 &encoded[0], encoded.size(), frequency);
+    stats.compressedBuffers++;
+    if (samples * sizeof(short) > encoded.size())
+        stats.compressedBytesSaved += samples * sizeof(short) - encoded.size();
+    return true;
+}
+
+void OpenALSoundSystem::SetClipPolicy(ClipPolicy policy) {
+    clipPolicy = policy;
+}
+
+OpenALSoundSystem::ClipPolicy OpenALSoundSystem::GetClipPolicy() {
+    return clipPolicy;
+}
+
+/**
+ * Plays per hot window, decayed exponentially since the last play,
+ * so a burst of plays long ago does not keep a clip hot.
+ */
+float OpenALSoundSystem::ClipHeat(ClipUsage& usage) {
+    if (usage.heat == 0.0) 
+        return 0.0;
+    float window = clipPolicy.hotWindow.AsInt64() / 1000000.0;
+    float dt = (timer.GetElapsedTime() - usage.lastPlay).AsInt64() / 1000000.0;
+    if (window <= 0.0) 
+        return 0.0;
+    return usage.heat * exp(-dt / window);
+}
+
+void OpenALSoundSystem::NoteClipPlay(ISoundResource* resource) {
+    map<ISoundResource*, ClipUsage>::iterator itr = clipUsage.find(resource);
+    if (itr == clipUsage.end()) 
+        return;
+    itr->second.heat = ClipHeat(itr->second) + 1.0;
+    itr->second.lastPlay = timer.GetElapsedTime();
+}
+
+ISound* OpenALSoundSystem::CreateClip(ISoundResourcePtr resource, BusID bus) {
+    if (bus >= buses.size())
+        throw Exception("tried to create a clip on an unknown mix bus");
+    SampleFormat format = SampleFormat::Of(resource);
+    map<ISoundResource*, ClipUsage>::iterator itr = clipUsage.find(resource.get());
+    if (itr == clipUsage.end()) {
+        ClipUsage usage;
+        usage.decodedSize = resource->GetBufferSize();
+        usage.frequency = resource->GetFrequency();
+        itr = clipUsage.insert(std::make_pair(resource.get(), usage)).first;
+    }
+    ClipUsage& usage = itr->second;
+
+    // a clip that already has a buffer costs nothing more to share
+    map<ISoundResourcePtr, ALuint>::iterator b = buffers.find(resource);
+    bool resident = b != buffers.end() && b->second != 0;
+    bool compressible = format.type != SampleFormat::FLOAT32 && format.channels <= 2;
+    if (resident || !compressible || 
+        usage.decodedSize <= clipPolicy.staticLimit ||
+        ClipHeat(usage) >= clipPolicy.hotPlays) {
+        if (usage.unloaded) {
+            resource->Load();
+            usage.unloaded = false;
+        }
+        stats.clipsStatic++;
+        return CreateSound(resource, bus);
+    }
+
+    if (!usage.data) {
+        usage.data = ClipDataPtr(new vector<char>());
+        EncodeAdpcm(format, resource->GetBuffer(), usage.decodedSize, *usage.data);
+        usage.frames = usage.decodedSize / format.FrameSize();
+        usage.channels = format.channels;
+        if (clipPolicy.unloadDecoded) {
+            resource->Unload();
+            usage.unloaded = true;
+        }
+    }
+    stats.clipsCompressed++;
+    IStreamingSoundResourcePtr clip(new CompressedClip(resource, usage.data, 
+                                                       usage.frequency, usage.channels,
+                                                       usage.frames));
+    return CreateSound(clip, bus);
+}
+
+ISound* OpenALSoundSystem::CreateSound(SoundBankPtr bank, string name,
+                                       BusID bus) {
+    const SoundBank::Entry* entry = bank->Find(name);
+    if (!entry)
+        throw Exception("sound bank " + bank->GetPath() + " has no clip " + name);
+    if (entry->encoding == SoundBank::IMA4)
+        return CreateSound(bank->GetStream(entry), bus);
+    ISoundResourcePtr& resource = bankResources[entry];
+    if (!resource)
+        resource = bank->GetResource(entry);
+    return CreateSound(resource, bus);
+}
+
+void OpenALSoundSystem::SetLevelOfDetail(bool enabled, 
+                                         float halfRateDistance,
+                                         float quarterRateDistance) {
+    lodEnabled = enabled;
+    lodDistance[0] = halfRateDistance;
+    lodDistance[1] = quarterRateDistance;
+}
+
+bool OpenALSoundSystem::GetLevelOfDetail() {
+    return lodEnabled;
+}
+
+static vector<char> Decimate(const char* data, unsigned int size,
+                             SampleFormat::Type type, unsigned int factor,
+                             SampleFormat::Type outType) {
+    unsigned int samples = size / SampleFormat(1, type).BytesPerSample();
+    vector<char> out((samples / factor) * SampleFormat(1, outType).BytesPerSample());
+    if (!out.empty())
+        SampleKernels::Decimator(type, outType)(data, &out[0], samples, factor);
+    return out;
+}
+
+void OpenALSoundSystem::CreateLODSet(ALuint buffer, const char* data, 
+                                     unsigned int size, unsigned int bits,
+                                     unsigned int frequency) {
+    if (bits != 8 && bits != 16) 
+        return;
+    LODSet set;
+    set.buffers[0] = buffer;
+    // rounded, the copies keep the length of the original closest
+    set.frequency[0] = frequency;
+    set.frequency[1] = (frequency + 1) / 2;
+    set.frequency[2] = (frequency + 2) / 4;
+    alGenBuffers(2, &set.buffers[1]);
+    SampleFormat::Type type = (bits == 8) ? SampleFormat::INT8 : SampleFormat::INT16;
+    vector<char> half = Decimate(data, size, type, 2, type);
+    vector<char> quarter = Decimate(data, size, type, 4, SampleFormat::INT8);
+    if (half.empty() || quarter.empty()) {
+        alDeleteBuffers(2, &set.buffers[1]);
+        return;
+    }
+    alBufferData(set.buffers[1], bits == 8 ? AL_FORMAT_MONO8 : AL_FORMAT_MONO16,
+                 &half[0], half.size(), set.frequency[1]);
+    alBufferData(set.buffers[2], AL_FORMAT_MONO8,
+                 &quarter[0], quarter.size(), set.frequency[2]);
+    lodSets[buffer] = set;
+    CheckError("Error creating detail levels: ");
+}
+
+void OpenALSoundSystem::DeleteLODSet(ALuint buffer) {
+    map<ALuint, LODSet>::iterator itr = lodSets.find(buffer);
+    if (itr == lodSets.end()) 
+        return;
+    alDeleteBuffers(2, &itr->second.buffers[1]);
+    lodSets.erase(itr);
+}
+
+/**
+ * The detail level for a distance. Bands overlap by a tenth of
+ * their distance so a voice at the edge does not switch back and
+ * forth.
+ */
+unsigned char OpenALSoundSystem::LevelFor(float distanceSquared,
+                                          unsigned char level) {
+    unsigned char target = 0;
+    for (unsigned char i = 0; i < 2; ++i) {
+        float edge = lodDistance[i] * (level > i ? 0.9 : 1.1);
+        if (distanceSquared > edge * edge)
+            target = i + 1;
+    }
+    return target;
+}
+
+/**
+ * Pick the detail level of a voice about to start from its
+ * distance, and return the buffer of the level.
+ */
+ALuint OpenALSoundSystem::StartLevel(unsigned int voice) {
+    voices.lodNext[voice] = -1;
+    map<ALuint, LODSet>::iterator set = lodSets.find(voices.buffer[voice]);
+    if (set == lodSets.end() || !lodEnabled || !voices.spatial[voice]) {
+        voices.lod[voice] = 0;
+        return voices.buffer[voice];
+    }
+    float distance = (voices.position[voice] - listenerPos).GetLengthSquared();
+    voices.lod[voice] = LevelFor(distance, voices.lod[voice]);
+    return set->second.buffers[voices.lod[voice]];
+}
+
+/**
+ * Bind the detail level of a mono voice about to be played. Looping
+ * voices get their buffer queued, so a later level can be queued
+ * behind it. A paused voice resumes with what it has.
+ */
+void OpenALSoundSystem::BindLevel(unsigned int voice) {
+    OpenALMonoSound* mono = voices.mono[voice];
+    if (!mono || lodSets.find(voices.buffer[voice]) == lodSets.end())
+        return;
+    ALuint source = voices.source[voice];
+    ALint state = 0;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    if (state == AL_PAUSED)
+        return;
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    ALuint buffer = StartLevel(voice);
+    if (mono->looping)
+        alSourceQueueBuffers(source, 1, &buffer);
+    else
+        alSourcei(source, AL_BUFFER, buffer);
+    alSourcei(source, AL_LOOPING, mono->looping);
+}
+
+/**
+ * Move a playing looping voice to the detail level for its distance
+ * at the end of its current pass, so the source is never restarted.
+ * Looping is turned off and the new level queued behind the current
+ * one, and PollLevelSwitches turns it back on once the old level has
+ * played out. Other voices keep the level they started with.
+ */
+void OpenALSoundSystem::UpdateLevelOfDetail(unsigned int voice,
+                                            float distanceSquared) {
+    map<ALuint, LODSet>::iterator set = lodSets.find(voices.buffer[voice]);
+    // the silence of a scheduled start is queued ahead of the buffer
+    if (set == lodSets.end() || voices.pad[voice] || voices.lodNext[voice] != -1)
+        return;
+    OpenALMonoSound* mono = voices.mono[voice];
+    if (!mono || !mono->looping)
+        return;
+    unsigned char target = LevelFor(distanceSquared, voices.lod[voice]);
+    if (target == voices.lod[voice])
+        return;
+
+    // the snapshot is from the last update, the voice may have
+    // stopped since
+    ALuint source = voices.source[voice];
+    ALint state = 0, type = 0, queued = 0;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    alGetSourcei(source, AL_SOURCE_TYPE, &type);
+    alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+    if (state != AL_PLAYING || type != AL_STREAMING || queued != 1)
+        return;
+    // a pass shorter than a few updates could end before the switch
+    // is picked up
+    if (BufferLength(voices.buffer[voice]) < 0.25)
+        return;
+    ALuint buffer = set->second.buffers[target];
+    alSourcei(source, AL_LOOPING, AL_FALSE);
+    alSourceQueueBuffers(source, 1, &buffer);
+    voices.lodNext[voice] = target;
+    lodSwitching.push_back(voice);
+}
+
+/**
+ * Finish the level switches whose old level has played out.
+ */
+void OpenALSoundSystem::PollLevelSwitches() {
+    for (unsigned int i = 0; i < lodSwitching.size(); ) {
+        unsigned int voice = lodSwitching[i];
+        ALuint source = voices.source[voice];
+        ALint processed = 0;
+        if (voices.lodNext[voice] != -1)
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+        if (voices.lodNext[voice] != -1 && processed < 1) {
+            ++i;
+            continue;
+        }
+        if (voices.lodNext[voice] != -1) {
+            ALuint old;
+            alSourceUnqueueBuffers(source, 1, &old);
+            voices.lod[voice] = voices.lodNext[voice];
+            voices.lodNext[voice] = -1;
+            OpenALMonoSound* mono = voices.mono[voice];
+            alSourcei(source, AL_LOOPING, mono && mono->looping);
+            stats.lodSwitches++;
+        }
+        lodSwitching[i] = lodSwitching.back();
+        lodSwitching.pop_back();
+    }
+    CheckError("Error switching detail levels: ");
+}
+
+/**
+ * A sample offset of a voice in samples of its full rate buffer.
+ */
+ALint OpenALSoundSystem::BaseOffset(unsigned int voice, ALint offset) {
+    unsigned char level = voices.lod[voice];
+    if (level == 0)
+        return offset;
+    map<ALuint, LODSet>::iterator set = lodSets.find(voices.buffer[voice]);
+    if (set == lodSets.end())
+        return offset;
+    return (ALint)((int64_t)offset * set->second.frequency[0]
+                   / set->second.frequency[level]);
+}
+
+float OpenALSoundSystem::BufferLength(ALuint buffer) {
+    if (!buffer) 
+        return 0.0;
+    ALint size, frequency, bits, channels;
+    alGetBufferi(buffer, AL_SIZE, &size);
+    alGetBufferi(buffer, AL_FREQUENCY, &frequency);
+    alGetBufferi(buffer, AL_BITS, &bits);
+    alGetBufferi(buffer, AL_CHANNELS, &channels);
+    if (frequency <= 0 || bits <= 0 || channels <= 0) 
+        return 0.0;
+    // IMA4 reports 4 bits, its blocks hold 65 samples in 36 bytes
+    if (bits == 4) 
+        return (float)(size / AdpcmEncoder::BLOCK_BYTES) * AdpcmEncoder::BLOCK_SAMPLES 
+            / (frequency * channels);
+    return (float)size / (frequency * channels * (bits / 8));
+}
+
+void OpenALSoundSystem::InitClock() {
+    alcGetInteger64vSOFT = NULL;
+    alSourcePlayAtTimevSOFT = NULL;
+    if (alcIsExtensionPresent(alcDevice, "ALC_SOFT_device_clock"))
+        alcGetInteger64vSOFT = (LPALCGETINTEGER64VSOFT)
+            alcGetProcAddress(alcDevice, "alcGetInteger64vSOFT");
+    // start times are given on the device clock
+    if (alcGetInteger64vSOFT && alIsExtensionPresent("AL_SOFT_source_start_delay"))
+        alSourcePlayAtTimevSOFT = (LPALSOURCEPLAYATTIMEVSOFT)
+            alGetProcAddress("alSourcePlayAtTimevSOFT");
+    if (!alSourcePlayAtTimevSOFT)
+        logger.info << "AL_SOFT_source_start_delay not supported, "
+                    << "scheduling plays with silence." << logger.end;
+    alGetSourcedvSOFT = NULL;
+    if (alIsExtensionPresent("AL_SOFT_source_latency"))
+        alGetSourcedvSOFT = (LPALGETSOURCEDVSOFT)
+            alGetProcAddress("alGetSourcedvSOFT");
+}
+
+/**
+ * Read the offset of the voice and correct the playback clock of its
+ * sound with it. With AL_SOFT_source_latency the offset comes in
+ * double precision together with the time until the mixed samples
+ * are heard, otherwise the latency is taken as zero. Silence padded
+ * in front is taken off, and streams add the buffers already played.
+ */
+void OpenALSoundSystem::SamplePosition(unsigned int voice, Time now) {
+    ALuint source = voices.source[voice];
+    double offset = 0.0;
+    double latency = 0.0;
+    if (alGetSourcedvSOFT) {
+        ALdouble values[2] = { 0.0, 0.0 };
+        alGetSourcedvSOFT(source, AL_SEC_OFFSET_LATENCY_SOFT, values);
+        offset = values[0];
+        latency = values[1];
+    } else {
+        ALfloat seconds = 0.0;
+        alGetSourcef(source, AL_SEC_OFFSET, &seconds);
+        offset = seconds;
+    }
+    voices.secOffset[voice] = (float)offset;
+    offset -= voices.padLength[voice];
+    OpenALStreamingSound* stream = voices.stream[voice];
+    if (stream && stream->frequency > 0)
+        offset += (double)stream->playedFrames / stream->frequency;
+    if (offset < 0.0) offset = 0.0;
+    voices.playOffset[voice] = offset;
+
+    double heard = offset > latency ? offset - latency : 0.0;
+    bool running = voices.state[voice] == AL_PLAYING;
+    if (voices.mono[voice])
+        voices.mono[voice]->clock.Update(now, heard, latency, running);
+    else if (stream)
+        stream->clock.Update(now, heard, latency, running);
+}
+
+/**
+ * The zero terminated attribute list of the context configuration.
+ * Switches the device has no extension for are left out.
+ */
+vector<ALCint> OpenALSoundSystem::ContextAttributes() {
+    vector<ALCint> attributes;
+    if (contextConfig.frequency) {
+        attributes.push_back(ALC_FREQUENCY);
+        attributes.push_back(contextConfig.frequency);
+    }
+    if (contextConfig.refresh) {
+        attributes.push_back(ALC_REFRESH);
+        attributes.push_back(contextConfig.refresh);
+    }
+    if (contextConfig.monoSources) {
+        attributes.push_back(ALC_MONO_SOURCES);
+        attributes.push_back(contextConfig.monoSources);
+    }
+    if (contextConfig.stereoSources) {
+        attributes.push_back(ALC_STEREO_SOURCES);
+        attributes.push_back(contextConfig.stereoSources);
+    }
+    if (contextConfig.hrtf != ContextConfig::DRIVER_DEFAULT) {
+        if (alcIsExtensionPresent(alcDevice, "ALC_SOFT_HRTF")) {
+            attributes.push_back(ALC_HRTF_SOFT);
+            attributes.push_back(contextConfig.hrtf == ContextConfig::ENABLED 
+                                 ? ALC_TRUE : ALC_FALSE);
+        } else
+            logger.info << "ALC_SOFT_HRTF not supported, "
+                        << "leaving HRTF to the driver." << logger.end;
+    }
+    if (contextConfig.limiter != ContextConfig::DRIVER_DEFAULT) {
+        if (alcIsExtensionPresent(alcDevice, "ALC_SOFT_output_limiter")) {
+            attributes.push_back(ALC_OUTPUT_LIMITER_SOFT);
+            attributes.push_back(contextConfig.limiter == ContextConfig::ENABLED 
+                                 ? ALC_TRUE : ALC_FALSE);
+        } else
+            logger.info << "ALC_SOFT_output_limiter not supported, "
+                        << "leaving the limiter to the driver." << logger.end;
+    }
+    attributes.push_back(0);
+    return attributes;
+}
+
+/**
+ * Log the attributes the context got, which the driver may have
+ * changed, and take the first sample of the device latency. The
+ * rest are taken by SampleLatency on the next process updates, so
+ * initialization does not wait for the mixer.
+ */
+void OpenALSoundSystem::ProbeLatency() {
+    ALCint frequency = 0, refresh = 0, monoSources = 0, stereoSources = 0;
+    alcGetIntegerv(alcDevice, ALC_FREQUENCY, 1, &frequency);
+    alcGetIntegerv(alcDevice, ALC_REFRESH, 1, &refresh);
+    alcGetIntegerv(alcDevice, ALC_MONO_SOURCES, 1, &monoSources);
+    alcGetIntegerv(alcDevice, ALC_STEREO_SOURCES, 1, &stereoSources);
+    ALCint hrtf = 0;
+    if (alcIsExtensionPresent(alcDevice, "ALC_SOFT_HRTF"))
+        alcGetIntegerv(alcDevice, ALC_HRTF_SOFT, 1, &hrtf);
+
+    logger.info << "OpenAL context: " << frequency << " Hz, " 
+                << refresh << " updates per second, "
+                << monoSources << " mono and " << stereoSources 
+                << " stereo sources, HRTF " << (hrtf ? "on" : "off") 
+                << logger.end;
+
+    deviceLatency = Time(0,0);
+    if (alcGetInteger64vSOFT) {
+        latencyProbes = 4;
+        SampleLatency();
+        return;
+    }
+    latencyProbes = 0;
+    if (refresh > 0)
+        deviceLatency = Time(1000000 / refresh);
+    logger.info << "OpenAL device latency: " << deviceLatency.AsInt64() / 1000.0
+                << " ms (one update, not measured)" << logger.end;
+}
+
+/**
+ * Take one sample of the device latency while probes remain, keeping
+ * the largest, and log the result after the last one.
+ */
+void OpenALSoundSystem::SampleLatency() {
+    if (latencyProbes == 0)
+        return;
+    ALCint64SOFT sample = 0;
+    alcGetInteger64vSOFT(alcDevice, ALC_DEVICE_LATENCY_SOFT, 1, &sample);
+    // nanoseconds
+    if (sample > 0 && (uint64_t)sample / 1000 > deviceLatency.AsInt64()) 
+        deviceLatency = Time((uint64_t)sample / 1000);
+    if (--latencyProbes == 0)
+        logger.info << "OpenAL device latency: " 
+                    << deviceLatency.AsInt64() / 1000.0 << " ms"
+                    << logger.end;
+}
+
+Time OpenALSoundSystem::GetDeviceTime() {
+    if (alcDevice && alcGetInteger64vSOFT) {
+        ALCint64SOFT clock = 0;
+        alcGetInteger64vSOFT(alcDevice, ALC_DEVICE_CLOCK_SOFT, 1, &clock);
+        // nanoseconds
+        return Time((uint64_t)(clock / 1000));
+    }
+    return timer.GetElapsedTime();
+}
+
+bool OpenALSoundSystem::IsScheduledPlaySupported() {
+    return alSourcePlayAtTimevSOFT != NULL;
+}
+
+void OpenALSoundSystem::PlayAfter(ISound* sound, Time offset) {
+    PlayAt(sound, GetDeviceTime() + offset);
+}
+
+void OpenALSoundSystem::PlayAt(ISound* sound, Time deviceTime) {
+    if (!alcContext) {
+        sound->Play();
+        return;
+    }
+    OpenALMonoSound* mono = dynamic_cast<OpenALMonoSound*>(sound);
+    OpenALStereoSound* stereo = dynamic_cast<OpenALStereoSound*>(sound);
+    OpenALStreamingSound* stream = dynamic_cast<OpenALStreamingSound*>(sound);
+    vector<unsigned int> list;
+    if (mono && voices.IsValid(mono->handle)) {
+        NoteClipPlay(mono->resource.get());
+        if (!AdmitInstance(mono->handle.index, mono->resource.get()))
+            return;
+        list.push_back(mono->handle.index);
+    }
+    else if (stereo && voices.IsValid(stereo->left->handle)) {
+        NoteClipPlay(stereo->res.get());
+        if (!AdmitInstance(stereo->left->handle.index, stereo->res.get()))
+            return;
+        list.push_back(stereo->left->handle.index);
+        list.push_back(stereo->right->handle.index);
+    }
+    else if (stream && voices.IsValid(stream->handle)) {
+        CompressedClip* clip = dynamic_cast<CompressedClip*>(stream->resource.get());
+        if (clip) 
+            NoteClipPlay(clip->GetSource().get());
+        WarmStream(stream);
+        list.push_back(stream->handle.index);
+    }
+    else
+        throw Exception("tried to schedule a sound that is not of this sound system");
+
+    ALuint sources[2];
+    for (unsigned int i = 0; i < list.size(); ++i) {
+        ClearPad(list[i]);
+        BindLevel(list[i]);
+        sources[i] = voices.source[list[i]];
+    }
+    if (alSourcePlayAtTimevSOFT) {
+        alSourcePlayAtTimevSOFT(list.size(), sources, 
+                                (ALint64SOFT)deviceTime.AsInt64() * 1000);
+        stats.playsScheduled++;
+    } else {
+        Time now = GetDeviceTime();
+        Time delay = deviceTime > now ? deviceTime - now : Time(0,0);
+        for (unsigned int i = 0; i < list.size(); ++i)
+            PadVoice(list[i], delay);
+        alSourcePlayv(list.size(), sources);
+        stats.playsPadded++;
+    }
+    for (unsigned int i = 0; i < list.size(); ++i)
+        SetSourceState(list[i], AL_PLAYING);
+    CheckError("Error scheduling sound: ");
+}
+
+/**
+ * A buffer of silence in the format and rate of another, 0 if the
+ * format has no plain silence or the length is zero.
+ */
+ALuint OpenALSoundSystem::MakeSilence(ALuint like, Time length) {
+    ALint frequency, bits, channels;
+    alGetBufferi(like, AL_FREQUENCY, &frequency);
+    alGetBufferi(like, AL_BITS, &bits);
+    alGetBufferi(like, AL_CHANNELS, &channels);
+    SampleFormat format(channels, SampleFormat::INT16);
+    if (bits == 8) 
+        format.type = SampleFormat::INT8;
+    else if (bits == 32) 
+        format.type = SampleFormat::FLOAT32;
+    else if (bits != 16) 
+        return 0;
+    unsigned int frames = length.AsInt64() * frequency / 1000000;
+    if (frames == 0 || channels <= 0) 
+        return 0;
+    // unsigned for 8 bit
+    vector<char> data(frames * format.FrameSize(), bits == 8 ? (char)0x80 : 0);
+    ALuint buffer;
+    alGenBuffers(1, &buffer);
+    BufferData(buffer, format, &data[0], data.size(), frequency);
+    return buffer;
+}
+
+/**
+ * Queue silence lasting delay ahead of what the voice plays. A
+ * static buffer is turned into a queue of the silence and the
+ * buffer, with looping off until the silence is over, see PollPads.
+ * A stream gets the silence at the front of its queue, which means
+ * stopping it first.
+ */
+void OpenALSoundSystem::PadVoice(unsigned int voice, Time delay) {
+    ALuint source = voices.source[voice];
+    OpenALStreamingSound* stream = voices.stream[voice];
+    ALint bound = 0;
+    ALint processed = 0;
+    if (stream) {
+        alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+        if ((unsigned int)processed >= stream->queuedBuffers.size()) 
+            return;
+        bound = stream->queuedBuffers[processed];
+    } else
+        alGetSourcei(source, AL_BUFFER, &bound);
+    if (!bound) 
+        return;
+    ALuint pad = MakeSilence(bound, delay);
+    if (!pad) 
+        return;
+    // played buffers go to the refills instead of being replayed
+    for (; stream && processed > 0; --processed) {
+        stream->idleBuffers.push_back(stream->queuedBuffers.front());
+        stream->queuedBuffers.pop_front();
+        stream->playedFrames += stream->queuedFrames.front();
+        stream->queuedFrames.pop_front();
+    }
+
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    alSourcei(source, AL_LOOPING, AL_FALSE);
+    alSourceQueueBuffers(source, 1, &pad);
+    if (stream) {
+        for (std::deque<ALuint>::iterator itr = stream->queuedBuffers.begin();
+             itr != stream->queuedBuffers.end(); ++itr)
+            alSourceQueueBuffers(source, 1, &*itr);
+        ALint frequency, size, bits, channels;
+        alGetBufferi(pad, AL_FREQUENCY, &frequency);
+        alGetBufferi(pad, AL_SIZE, &size);
+        alGetBufferi(pad, AL_BITS, &bits);
+        alGetBufferi(pad, AL_CHANNELS, &channels);
+        stream->queuedBuffers.push_front(pad);
+        stream->queuedFrames.push_front(size / (bits / 8 * channels));
+    } else {
+        ALuint buffer = bound;
+        alSourceQueueBuffers(source, 1, &buffer);
+    }
+    voices.pad[voice] = pad;
+    voices.padLength[voice] = BufferLength(pad);
+    paddedVoices.push_back(voice);
+}
+
+/**
+ * Take the silence off the front of the voice before it is played
+ * or stopped another way. Stops the voice.
+ */
+void OpenALSoundSystem::ClearPad(unsigned int voice) {
+    ALuint pad = voices.pad[voice];
+    if (!pad) 
+        return;
+    ALuint source = voices.source[voice];
+    OpenALStreamingSound* stream = voices.stream[voice];
+    alSourceStop(source);
+    if (stream) {
+        alSourcei(source, AL_BUFFER, 0);
+        stream->queuedBuffers.pop_front();
+        stream->queuedFrames.pop_front();
+        for (std::deque<ALuint>::iterator itr = stream->queuedBuffers.begin();
+             itr != stream->queuedBuffers.end(); ++itr)
+            alSourceQueueBuffers(source, 1, &*itr);
+    } else {
+        ALuint queue[2];
+        alSourceUnqueueBuffers(source, 2, queue);
+        alSourcei(source, AL_BUFFER, queue[1]);
+        if (voices.mono[voice]) 
+            alSourcei(source, AL_LOOPING, voices.mono[voice]->looping);
+    }
+    alDeleteBuffers(1, &pad);
+    voices.pad[voice] = 0;
+    voices.padLength[voice] = 0.0;
+}
+
+/**
+ * Drop the silence of scheduled starts once it has played, and
+ * give looping voices their looping back.
+ */
+void OpenALSoundSystem::PollPads() {
+    for (unsigned int i = 0; i < paddedVoices.size(); ) {
+        unsigned int voice = paddedVoices[i];
+        ALuint source = voices.source[voice];
+        ALint processed = 0;
+        if (voices.pad[voice]) 
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+        if (voices.pad[voice] && processed < 1) {
+            ++i;
+            continue;
+        }
+        if (voices.pad[voice]) {
+            ALuint pad;
+            alSourceUnqueueBuffers(source, 1, &pad);
+            alDeleteBuffers(1, &pad);
+            voices.pad[voice] = 0;
+            voices.padLength[voice] = 0.0;
+            OpenALStreamingSound* stream = voices.stream[voice];
+            if (stream) {
+                stream->queuedBuffers.pop_front();
+                stream->queuedFrames.pop_front();
+            }
+            else if (voices.mono[voice] && voices.mono[voice]->looping)
+                alSourcei(source, AL_LOOPING, AL_TRUE);
         }
+        paddedVoices[i] = paddedVoices.back();
+        paddedVoices.pop_back();
     }
-    else throw Exception("unsupported sound format");
-    return sound;
+    CheckError("Error removing start silence: ");
+}
+
+SoundHandle OpenALSoundSystem::GetHandle(ISound* sound) {
+    OpenALMonoSound* mono = dynamic_cast<OpenALMonoSound*>(sound);
+    if (mono) return mono->handle;
+    OpenALStereoSound* stereo = dynamic_cast<OpenALStereoSound*>(sound);
+    if (stereo) return stereo->left->handle;
+    OpenALStreamingSound* stream = dynamic_cast<OpenALStreamingSound*>(sound);
+    if (stream) return stream->handle;
+    return SoundHandle();
+}
+
+ISound* OpenALSoundSystem::GetSound(SoundHandle handle) {
+    if (!voices.IsValid(handle)) 
+        return NULL;
+    return voices.owner[handle.index];
+}
+
+bool OpenALSoundSystem::IsValid(SoundHandle handle) {
+    return voices.IsValid(handle);
+}
+
+void OpenALSoundSystem::DestroySound(SoundHandle handle) {
+    if (!voices.IsValid(handle))
+        throw Exception("tried to destroy a sound through a stale handle");
+    DestroySound(voices.owner[handle.index]);
 }
 
 void OpenALSoundSystem::SetMasterGain(float gain) {
@@ -152,24 +2494,16 @@ void OpenALSoundSystem::SetMasterGain(float gain) {
 		return;
 	if (gain < 0.0)
 		gain = 0.0;
-    ALCenum error;
     alListenerf(AL_GAIN, (ALfloat)gain);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to set gain but got: "
-		      + Convert::ToString(error));
-    }
+    CheckError("tried to set gain but got: ");
 }
 
 float OpenALSoundSystem::GetMasterGain() {
 	if (!alcContext)
 		return 0.0;
     float gain;
-    ALCenum error;
     alGetListenerf(AL_GAIN, (ALfloat*)&gain);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to get gain but got: "
-		      + Convert::ToString(error));
-    }
+    CheckError("tried to get gain but got: ");
     return gain;
 }
 
@@ -181,37 +2515,51 @@ void OpenALSoundSystem::Handle(ALStreamEventArg e) {
     ApplyAction(e);
 }
 void OpenALSoundSystem::ApplyAction(ALStreamEventArg e) {
-    ALCenum error;
     string errstr;
-    ALuint sourceID = e.sound->sourceID;
+    unsigned int voice = e.sound->handle.index;
+    ALuint sourceID = voices.source[voice];
     
     //DEBUG_ME();
     //logger.info << "action " << e.action << logger.end;
     
     switch (e.action) {
     case ISound::PLAY: 
+        {
+            CompressedClip* clip = dynamic_cast<CompressedClip*>(e.sound->resource.get());
+            if (clip) 
+                NoteClipPlay(clip->GetSource().get());
+        }
+        WarmStream(e.sound);
+        ClearPad(voice);
         alSourcePlay(sourceID);
-        playingStreams.insert(e.sound);
+        SetSourceState(voice, AL_PLAYING);
         break;
     case ISound::STOP: 
+        ClearPad(voice);
         alSourceStop(sourceID);        
-        playingStreams.erase(e.sound);
+        SetSourceState(voice, AL_STOPPED);
         break;
     case ISound::PAUSE:
         alSourcePause(sourceID);
+        SetSourceState(voice, AL_PAUSED);
         break;
     case ISound::LOOP:
-        alSourcei(sourceID, AL_LOOPING, (ALboolean)true);
+        // looped by the refills, AL_LOOPING would only repeat the
+        // queued buffers
+        e.sound->looping = true;
+        // an ended stream starts over on the next refill
+        e.sound->exhausted = false;
+        SetReadAheadLoop(e.sound);
         break;
     case ISound::NO_LOOP:
-        alSourcei(sourceID, AL_LOOPING, (ALboolean)false);
+        e.sound->looping = false;
+        SetReadAheadLoop(e.sound);
         break;
     default:
         throw Exception("FADE_UP and FADE_DOWN, not implemented");
         break;
     }
-    if ((error = alGetError()) != AL_NO_ERROR)
-        throw Exception("Error applying sound action: " + Convert::ToString(error));
+    CheckError("Error applying sound action: ");
 }
 
 
@@ -224,24 +2572,38 @@ void OpenALSoundSystem::Handle(ALMonoEventArg e) {
 }
 
 void OpenALSoundSystem::ApplyAction(ALMonoEventArg e) {
-    ALCenum error;
     string errstr;
-    ALuint sourceID = e.sound->sourceID;
+    unsigned int voice = e.sound->handle.index;
+    ALuint sourceID = voices.source[voice];
     switch (e.action) {
     case ISound::PLAY: 
+        NoteClipPlay(e.sound->resource.get());
+        if (!AdmitInstance(voice, e.sound->resource.get()))
+            break;
+        ClearPad(voice);
+        BindLevel(voice);
         alSourcePlay(sourceID);
+        SetSourceState(voice, AL_PLAYING);
         break;
     case ISound::STOP: 
+        ClearPad(voice);
         alSourceStop(sourceID);
+        SetSourceState(voice, AL_STOPPED);
         break;
     case ISound::PAUSE:
         alSourcePause(sourceID);
+        SetSourceState(voice, AL_PAUSED);
         break;
     case ISound::LOOP:
-        alSourcei(sourceID, AL_LOOPING, (ALboolean)true);
+        // a queued level switch turns looping back on, see
+        // PollLevelSwitches
+        if (voices.lodNext[voice] == -1)
+            alSourcei(sourceID, AL_LOOPING, (ALboolean)true);
+        e.sound->looping = true;
         break;
     case ISound::NO_LOOP:
         alSourcei(sourceID, AL_LOOPING, (ALboolean)false);
+        e.sound->looping = false;
         break;
     case ISound::FADE_UP:
         timedExecutioner.Add(new RWValueCall<IMonoSound,float>(*e.sound, &IMonoSound::GetGain, &IMonoSound::SetGain),
@@ -252,8 +2614,7 @@ void OpenALSoundSystem::ApplyAction(ALMonoEventArg e) {
                           e.sound->GetGain(), 0.0f, fadeTime);
         break;
     }
-    if ((error = alGetError()) != AL_NO_ERROR)
-        throw Exception("Error applying sound action: " + Convert::ToString(error));
+    CheckError("Error applying sound action: ");
 }
 
 void OpenALSoundSystem::Handle(ALStereoEventArg e) {
@@ -265,7 +2626,6 @@ void OpenALSoundSystem::Handle(ALStereoEventArg e) {
 }
 
 void OpenALSoundSystem::ApplyAction(ALStereoEventArg e) {
-    ALCenum error;
     string errstr;
     ALuint list[2];
     list[0] = e.sound->left->GetID();
@@ -273,54 +2633,50 @@ void OpenALSoundSystem::ApplyAction(ALStereoEventArg e) {
     switch (e.action) {
     case ISound::PLAY:
         // logger.info << "play sound" << logger.end;
+        NoteClipPlay(e.sound->res.get());
+        if (!AdmitInstance(e.sound->left->handle.index, e.sound->res.get()))
+            break;
+        ClearPad(e.sound->left->handle.index);
+        ClearPad(e.sound->right->handle.index);
         alSourcePlayv(2, list);
+        SetSourceState(e.sound->left->handle.index, AL_PLAYING);
+        SetSourceState(e.sound->right->handle.index, AL_PLAYING);
         break;
     case ISound::STOP: 
+        ClearPad(e.sound->left->handle.index);
+        ClearPad(e.sound->right->handle.index);
         alSourceStopv(2, &list[0]);
+        SetSourceState(e.sound->left->handle.index, AL_STOPPED);
+        SetSourceState(e.sound->right->handle.index, AL_STOPPED);
         break;
     case ISound::PAUSE:
         alSourcePausev(2, &list[0]);
+        SetSourceState(e.sound->left->handle.index, AL_PAUSED);
+        SetSourceState(e.sound->right->handle.index, AL_PAUSED);
         break;
     case ISound::LOOP:
         alSourcei(list[0], AL_LOOPING, (ALboolean)true);
         alSourcei(list[1], AL_LOOPING, (ALboolean)true);
+        e.sound->left->looping = e.sound->right->looping = true;
         break;
     case ISound::NO_LOOP:
         alSourcei(list[0], AL_LOOPING, (ALboolean)false);
         alSourcei(list[1], AL_LOOPING, (ALboolean)false);
+        e.sound->left->looping = e.sound->right->looping = false;
         break;
     default:
         break;
     }
-    if ((error = alGetError()) != AL_NO_ERROR)
-        throw Exception("Error applying sound action: " + Convert::ToString(error));
+    CheckError("Error applying sound action: ");
 }
 
-void OpenALSoundSystem::InitResource(IStreamingSoundResourcePtr resource) {
+void OpenALSoundSystem::InitResource(IStreamingSoundResourcePtr resource,
+                                     DecodeJob* prefetched) {
     if (bufferList[resource].size() != 0) {
         return;
     }
 
-    ALuint format = 0;
-    if(resource->GetFormat() == MONO) {
-        if (resource->GetBitsPerSample() == 8)
-            format = AL_FORMAT_MONO8;
-        else if (resource->GetBitsPerSample() == 16)
-            format = AL_FORMAT_MONO16;
-        else
-            throw Exception("unknown number of bits per sample");
-        }
-    else if(resource->GetFormat() == STEREO) {
-        if (resource->GetBitsPerSample() == 8)
-            format = AL_FORMAT_STEREO8;
-        else if (resource->GetBitsPerSample() == 16)
-            format = AL_FORMAT_STEREO16;
-        else
-            throw Exception("Unknown number of bits per sample.");
-    }
-    else
-        throw Exception("Unknown sound format.");
-
+    SampleFormat format = SampleFormat::Of(resource);
     
     ALuint buffer[2];
     alGenBuffers(2, buffer);
@@ -331,106 +2687,187 @@ void OpenALSoundSystem::InitResource(IStreamingSoundResourcePtr resource) {
     
     for (int i=0;i<2;i++) {
         bufferList[resource].push_back(buffer[i]);
+        if (prefetched) {
+            BufferData(buffer[i], format, &prefetched->data[i * prefetched->chunkSize],
+                       prefetched->sizes[i], resource->GetFrequency());
+            continue;
+        }
         unsigned int read = resource->GetBuffer(bsize, buf);
         
-        alBufferData(buffer[i], format, buf, read, resource->GetFrequency());
+        BufferData(buffer[i], format, buf, read, resource->GetFrequency());
 
     }
 }
-void OpenALSoundSystem::InitResource(ISoundResourcePtr resource) {
+void OpenALSoundSystem::InitResource(ISoundResourcePtr resource, BusID bus) {
     if (buffers[resource] != 0) {
         return;
     }
     ALuint buffer;
-    ALuint format = 0;
-    if(resource->GetFormat() == MONO) {
-        if (resource->GetBitsPerSample() == 8)
-            format = AL_FORMAT_MONO8;
-        else if (resource->GetBitsPerSample() == 16)
-            format = AL_FORMAT_MONO16;
-        else
-            throw Exception("unknown number of bits per sample");
+    SampleFormat format = SampleFormat::Of(resource);
+    const char* data = resource->GetBuffer();
+    unsigned int size = resource->GetBufferSize();
+    unsigned int bits = resource->GetBitsPerSample();
+    unsigned int frequency = resource->GetFrequency();
+    map<ISoundResource*, bool>::iterator c = compression.find(resource.get());
+    bool compress = (c != compression.end()) ? c->second : buses[bus].compress;
+
+    bool resample = resampleToDevice && deviceFrequency > 0 &&
+        frequency != (unsigned int)deviceFrequency &&
+        format.type != SampleFormat::FLOAT32 && format.channels <= 2;
+    ContentEntry entry(0, resource, compress,
+                       resample ? deviceFrequency : frequency,
+                       lodEnabled && format.channels == 1);
+
+    // identical samples uploaded the same way share a buffer
+    uint64_t hash = ConversionCache::HashData(data, size, frequency);
+    hash = ConversionCache::Hash(format.channels * 4 + format.type, hash);
+    hash = ConversionCache::Hash(compress, hash);
+    hash = ConversionCache::Hash(entry.rate, hash);
+    hash = ConversionCache::Hash(entry.lod, hash);
+    buffer = FindIdenticalBuffer(hash, entry);
+    if (buffer) {
+        buffers[resource] = buffer;
+        stats.buffersShared++;
+        stats.bytesShared += size;
+        return;
+    }
+
+    vector<char> converted;
+    if (resample) {
+        ConvertToDeviceRate(data, size, bits, format.channels, frequency, converted);
+        if (!converted.empty()) {
+            data = &converted[0];
+            size = converted.size();
+            bits = 16;
+            frequency = deviceFrequency;
+            format.type = SampleFormat::INT16;
         }
-    else if(resource->GetFormat() == STEREO) {
-        if (resource->GetBitsPerSample() == 8)
-            format = AL_FORMAT_STEREO8;
-        else if (resource->GetBitsPerSample() == 16)
-            format = AL_FORMAT_STEREO16;
-        else
-            throw Exception("Unknown number of bits per sample.");
     }
-    else
-        throw Exception("Unknown sound format.");
     alGenBuffers(1, &buffer);
-    alBufferData(buffer, format, resource->GetBuffer(),
-                 resource->GetBufferSize(), resource->GetFrequency());
     buffers[resource] = buffer;
+    entry.buffer = buffer;
+    contentBuffers.insert(std::make_pair(hash, entry));
+    // compressed buffers get no detail levels, those would be PCM
+    if (compress && UploadCompressed(buffer, format, data, size, frequency))
+        return;
+    BufferData(buffer, format, data, size, frequency);
+    if (entry.lod)
+        CreateLODSet(buffer, data, size, bits, frequency);
     // logger.info << "buffer: " << buffer << logger.end;
 }
 
+/**
+ * A buffer holding the same samples as the resource, uploaded with
+ * the same options, or zero. Hash matches are compared byte by byte.
+ */
+ALuint OpenALSoundSystem::FindIdenticalBuffer(uint64_t hash, 
+                                              const ContentEntry& wanted) {
+    ISoundResourcePtr resource = wanted.resource;
+    pair<multimap<uint64_t, ContentEntry>::iterator,
+         multimap<uint64_t, ContentEntry>::iterator> range = 
+        contentBuffers.equal_range(hash);
+    for (multimap<uint64_t, ContentEntry>::iterator itr = range.first;
+         itr != range.second; ++itr) {
+        ISoundResourcePtr other = itr->second.resource;
+        if (itr->second.compressed != wanted.compressed ||
+            itr->second.rate != wanted.rate ||
+            itr->second.lod != wanted.lod ||
+            other->GetBufferSize() != resource->GetBufferSize() ||
+            other->GetFrequency() != resource->GetFrequency() ||
+            !(SampleFormat::Of(other) == SampleFormat::Of(resource)))
+            continue;
+        // the first resource may have been unloaded since
+        const char* a = other->GetBuffer();
+        const char* b = resource->GetBuffer();
+        if (a && b && memcmp(a, b, resource->GetBufferSize()) == 0)
+            return itr->second.buffer;
+    }
+    return 0;
+}
+
+// drop every reference to a deleted buffer
+void OpenALSoundSystem::ForgetBuffer(ALuint buffer) {
+    for (map<ISoundResourcePtr, ALuint>::iterator b = buffers.begin();
+         b != buffers.end(); ) {
+        if (b->second == buffer) buffers.erase(b++);
+        else ++b;
+    }
+    for (multimap<uint64_t, ContentEntry>::iterator c = contentBuffers.begin();
+         c != contentBuffers.end(); ) {
+        if (c->second.buffer == buffer) contentBuffers.erase(c++);
+        else ++c;
+    }
+}
+
 void OpenALSoundSystem::InitSound(OpenALStreamingSound* sound) {
     ALuint source;
     alGenSources(1, &source);
 
-    ALCenum error;
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("Error generating source: "
-                        + Convert::ToString(error));
-    }
+    CheckError("Error generating source: ");
     
-    ALuint _buffers[2];
-    for (int i=0;i<2;i++) {
-        _buffers[i] = (bufferList[sound->resource]).at(i);
-    }
-
-    alSourceQueueBuffers(source, 2, _buffers);
-    sound->sourceID = source;
-    sound->bufferIDs = bufferList[sound->resource];
+    unsigned int voice = sound->handle.index;
+    voices.source[voice] = source;
+    sourceIndex[source] = voice;
+    if (!sound->lazy)
+        QueueStreamBuffers(sound);
     sound->length = sound->CalculateLength();
 
 
     // set sound attributes (ugly stuff)...
     alSourcei(source, AL_ROLLOFF_FACTOR, 1.0f);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set rolloff factor but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set rolloff factor but got: ");
         
     alSourcei(source, AL_REFERENCE_DISTANCE, 50.0f);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set rolloff factor but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set rolloff factor but got: ");
         
     alSourcei(source, AL_MAX_DISTANCE, sound->maxdist);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set rolloff factor but got: "
-                        + Convert::ToString(error));
-    }
-    alSourcef(source, AL_GAIN, sound->gain);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set gain but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set rolloff factor but got: ");
+    ApplyGain(voice);
+    CheckError("tried to set gain but got: ");
 
     alSourcei(source, AL_SOURCE_RELATIVE, sound->rel);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set source relative but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set source relative but got: ");
         
-    UpdatePosition(sound);
+    UpdatePosition(voice);
+}
+void OpenALSoundSystem::QueueStreamBuffers(OpenALStreamingSound* sound) {
+    ALuint _buffers[2];
+    for (int i=0;i<2;i++) {
+        _buffers[i] = (bufferList[sound->resource]).at(i);
+    }
+
+    alSourceQueueBuffers(voices.source[sound->handle.index], 2, _buffers);
+    sound->bufferIDs = bufferList[sound->resource];
+    sound->queuedBuffers.clear();
+    sound->queuedFrames.clear();
+    sound->playedFrames = 0;
+    sound->segmentFrames = 0;
+    sound->readFrames = 0;
+    sound->passStarts.clear();
+    sound->passStarts.push_back(OpenALStreamingSound::PassStart(0, 0));
+    for (int i=0;i<2;i++) {
+        sound->queuedBuffers.push_back(_buffers[i]);
+        ALint size, bits, channels;
+        alGetBufferi(_buffers[i], AL_SIZE, &size);
+        alGetBufferi(_buffers[i], AL_BITS, &bits);
+        alGetBufferi(_buffers[i], AL_CHANNELS, &channels);
+        unsigned int frameSize = (bits / 8) * channels;
+        sound->queuedFrames.push_back(frameSize ? size / frameSize : 0);
+        sound->segmentFrames += sound->queuedFrames.back();
+        sound->readFrames += sound->queuedFrames.back();
+    }
+    bufferRefs[_buffers[0]]++;
+    bufferRefs[_buffers[1]]++;
+    sound->warm = true;
+    CheckError("Error queueing stream buffers: ");
 }
+
 void OpenALSoundSystem::InitSound(OpenALMonoSound* sound) {
     //generate the source
     ALuint source;
     alGenSources(1, &source);
 
-    ALCenum error;
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("Error generating source: "
-                        + Convert::ToString(error));
-    }
+    CheckError("Error generating source: ");
         
     //attach the buffer
     ALuint buffer = buffers[sound->resource];
@@ -438,45 +2875,30 @@ void OpenALSoundSystem::InitSound(OpenALMonoSound* sound) {
 
     alSourcei(source, AL_BUFFER, buffer);
     
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("Error binding buffer: "
-                        + Convert::ToString(error));
-    }
-    sound->sourceID = source;
-    sound->bufferID = buffer;
+    CheckError("Error binding buffer: ");
+    unsigned int voice = sound->handle.index;
+    voices.source[voice] = source;
+    voices.buffer[voice] = buffer;
+    sourceIndex[source] = voice;
+    bufferRefs[buffer]++;
     sound->length = sound->CalculateLength();
         
     // set sound attributes (ugly stuff)...
     alSourcei(source, AL_ROLLOFF_FACTOR, 1.0f);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set rolloff factor but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set rolloff factor but got: ");
         
     alSourcei(source, AL_REFERENCE_DISTANCE, 50.0f);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set rolloff factor but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set rolloff factor but got: ");
         
     alSourcei(source, AL_MAX_DISTANCE, sound->maxdist);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set rolloff factor but got: "
-                        + Convert::ToString(error));
-    }
-    alSourcef(source, AL_GAIN, sound->gain);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set gain but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set rolloff factor but got: ");
+    ApplyGain(voice);
+    CheckError("tried to set gain but got: ");
 
     alSourcei(source, AL_SOURCE_RELATIVE, sound->rel);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set source relative but got: "
-                        + Convert::ToString(error));
-    }
+    CheckError("tried to set source relative but got: ");
         
-    UpdatePosition(sound);
+    UpdatePosition(voice);
 }
 
 void OpenALSoundSystem::Handle(Core::InitializeEventArg arg) {
@@ -485,38 +2907,38 @@ void OpenALSoundSystem::Handle(Core::InitializeEventArg arg) {
         logger.error << "OpenAL not initialized." << logger.end;
         return;
     }
-    alcContext = alcCreateContext(alcDevice, NULL);
+    vector<ALCint> attributes = ContextAttributes();
+    alcContext = alcCreateContext(alcDevice, &attributes[0]);
+    if (!alcContext && attributes.size() > 1) {
+        logger.warning << "Could not create the configured OpenAL context, "
+                       << "using the driver defaults." << logger.end;
+        alcContext = alcCreateContext(alcDevice, NULL);
+    }
     alcMakeContextCurrent(alcContext); 
+    alcGetIntegerv(alcDevice, ALC_FREQUENCY, 1, &deviceFrequency);
+    InitFormats();
     alListener3f(AL_POSITION, 0.0f, 0.0f, 0.0f);
     alDistanceModel(AL_LINEAR_DISTANCE);
     logger.info << "OpenAL has been initialized using device: " << devices[device] << logger.end;
 
-    // init buffers
-    map<ISoundResourcePtr, ALuint>::iterator j = buffers.begin();
-    for (; j != buffers.end(); ++j) {
-        ISoundResourcePtr resource = (*j).first;
-        InitResource(resource);
-    }
-    
-    // init streaming buffers
-    map<IStreamingSoundResourcePtr, vector<ALuint> >::iterator k = bufferList.begin();
-    for (; k != bufferList.end(); ++k) {
-        IStreamingSoundResourcePtr resource = (*k).first;
-        InitResource(resource);
-    }
-
-    // init sounds
-    list<OpenALMonoSound*>::iterator i = monos.begin();
-    for (; i != monos.end(); ++i) {
-        OpenALMonoSound* sound = (*i);
-        InitSound(sound);
-    }
-
-    // init streaming sounds
-    list<OpenALStreamingSound*>::iterator l = streams.begin();
-    for(; l != streams.end(); ++l) {
-        OpenALStreamingSound* sound = (*l);
-        InitSound(sound);
+    InitEvents();
+    InitClock();
+    ProbeLatency();
+    GrowOneShotPool(oneShotVoices);
+    decodeWorker.Start();
+    streamReader.Start(streamWorkers);
+
+    // init the sounds created before the context
+    for (unsigned int i = 0; i < voices.Size(); ++i) {
+        if (voices.mono[i]) {
+            InitResource(voices.mono[i]->resource, voices.bus[i]);
+            InitSound(voices.mono[i]);
+        }
+        else if (voices.stream[i]) {
+            if (!voices.stream[i]->lazy)
+                InitResource(voices.stream[i]->resource);
+            InitSound(voices.stream[i]);
+        }
     }
     
     // process queued events
@@ -532,7 +2954,7 @@ void OpenALSoundSystem::Handle(Core::InitializeEventArg arg) {
         ApplyAction(streamActions.front());
         streamActions.pop();
     }
-
+    FlushErrors("initialization");
 }
 
 void OpenALSoundSystem::Handle(RenderingEventArg arg) {
@@ -542,87 +2964,469 @@ void OpenALSoundSystem::Handle(RenderingEventArg arg) {
     const float deltaTime = arg.approx;
 
     IViewingVolume* vv = arg.canvas.GetViewingVolume();
-	
-    Vector<3,float> vvpos = vv->GetPosition();
-    alListener3f(AL_POSITION, vvpos[0], vvpos[1], vvpos[2]);
+    visitor.SetDeltaTime(deltaTime);
+    arg.canvas.GetScene()->Accept(visitor);
+    UpdateListener(vv->GetPosition(), vv->GetDirection());
+}
+
+void OpenALSoundSystem::UpdateListener(Vector<3,float> position,
+                                       Quaternion<float> direction) {
+	if (!alcContext)
+		return;
+    listenerPos = position;
+    alListener3f(AL_POSITION, position[0], position[1], position[2]);
     
     // Give camera orientation to openal
-    Quaternion<float> rot = vv->GetDirection();
-    Vector<3,float> up = rot.RotateVector(Vector<3,float>(0,1,0));
-    Vector<3,float> dir = rot.RotateVector(Vector<3,float>(0,0,-1));
+    Vector<3,float> up = direction.RotateVector(Vector<3,float>(0,1,0));
+    Vector<3,float> dir = direction.RotateVector(Vector<3,float>(0,0,-1));
     float orientation[6];
     dir.ToArray(orientation);
     up.ToArray(&orientation[3]);
     alListenerfv(AL_ORIENTATION, orientation);
     
-    visitor.SetDeltaTime(deltaTime);
-    arg.canvas.GetScene()->Accept(visitor);
-}
-
-void OpenALSoundSystem::Handle(Core::ProcessEventArg arg) {
-    
-    for (set<OpenALStreamingSound*>::iterator itr = playingStreams.begin();
-         itr != playingStreams.end();
-         itr++) {
-        // Refresh stream...
-        OpenALStreamingSound *sound = *itr;
-        ALuint source = sound->sourceID;
-        ALint processed;
+    CullVoices();
+    PredictPrefetches();
+    FlushErrors("rendering update");
+}
+
+/**
+ * Work out when each stream runs dry from the frames it has queued
+ * and the offset of its source, and refill the streams with played
+ * buffers earliest deadline first. Once the refills have taken the
+ * budget the rest wait for the next update. The reader is told the
+ * deadlines as well, so it reads the most urgent streams first.
+ */
+void OpenALSoundSystem::ScheduleRefills() {
+    Time now = timer.GetElapsedTime();
+    streamRefills.clear();
+    for (unsigned int i = 0; i < activeVoices.size(); ++i) {
+        unsigned int voice = activeVoices[i];
+        if (!voices.active[voice] || !voices.stream[voice]) 
+            continue;
+        OpenALStreamingSound *sound = voices.stream[voice];
+        ALuint source = voices.source[voice];
+        ALint processed, queued, offset;
         alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
-    
-    
-        IStreamingSoundResourcePtr resource = sound->resource;
-        
-        ALuint format = 0;
-        if(resource->GetFormat() == MONO) {
-            if (resource->GetBitsPerSample() == 8)
-                format = AL_FORMAT_MONO8;
-            else if (resource->GetBitsPerSample() == 16)
-                format = AL_FORMAT_MONO16;
-            else
-                throw Exception("unknown number of bits per sample");
-        }
-        else if(resource->GetFormat() == STEREO) {
-            if (resource->GetBitsPerSample() == 8)
-                format = AL_FORMAT_STEREO8;
-            else if (resource->GetBitsPerSample() == 16)
-                format = AL_FORMAT_STEREO16;
-            else
-                throw Exception("Unknown number of bits per sample.");
-        }
-        else
-            throw Exception("Unknown sound format.");
-
-    
-
-        while (processed--) {
-            
-            ALuint buffer;
-        
-            alSourceUnqueueBuffers(source, 1, &buffer);
-
+        alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+        alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+
+        // the offset counts from the first queued buffer
+        int64_t frames = -offset;
+        for (std::deque<unsigned int>::iterator itr = sound->queuedFrames.begin();
+             itr != sound->queuedFrames.end(); ++itr)
+            frames += *itr;
+        if (frames < 0 || processed == queued)
+            frames = 0;
+        unsigned int frequency = sound->frequency;
+        int64_t left = frequency ? frames * 1000000 / frequency : 0;
+        if (sound->readAhead)
+            streamReader.SetQueued(sound->readAhead, left);
+
+        if (processed <= 0 && 
+            (sound->idleBuffers.empty() || sound->exhausted)) 
+            continue;
+        if (processed == queued && !sound->exhausted && 
+            voices.state[voice] == AL_PLAYING)
+            stats.refillDeadlinesMissed++;
+        streamRefills.push_back(StreamRefill(voice, processed, 
+                                             now.AsInt64() + left));
+    }
+    std::sort(streamRefills.begin(), streamRefills.end());
 
-            unsigned int bsize = 32*1024;
-            char buf[bsize];
+    for (unsigned int i = 0; i < streamRefills.size(); ++i) {
+        if (i > 0 && refillBudget.AsInt64() > 0 &&
+            (timer.GetElapsedTime() - now).AsInt64() > refillBudget.AsInt64()) {
+            stats.refillsDeferred += streamRefills.size() - i;
+            break;
+        }
+        RefillStream(streamRefills[i].voice, streamRefills[i].processed);
+    }
+}
 
-            unsigned int read = resource->GetBuffer(bsize, buf);
-            //logger.info << "read " << read << logger.end;
-            alBufferData(buffer, format, buf, read, resource->GetFrequency());
-            sound->last_offset += read;
- 
-            alSourceQueueBuffers(source, 1, &buffer);
-            
+void OpenALSoundSystem::RefillStream(unsigned int voice, ALint processed) {
+    OpenALStreamingSound *sound = voices.stream[voice];
+    ALuint source = voices.source[voice];
+    SampleFormat format = sound->format;
 
-            //logger.info << "unqueued " << sound->last_offset << logger.end;
-            
+    while (processed--) {
+        ALuint buffer;
+        alSourceUnqueueBuffers(source, 1, &buffer);
+        if (!sound->queuedFrames.empty()) {
+            sound->queuedBuffers.pop_front();
+            sound->playedFrames += sound->queuedFrames.front();
+            sound->queuedFrames.pop_front();
+        }
+        sound->idleBuffers.push_back(buffer);
+    }
+    // forget the passes played through
+    uint64_t played = sound->readFrames;
+    for (std::deque<unsigned int>::iterator itr = sound->queuedFrames.begin();
+         itr != sound->queuedFrames.end(); ++itr)
+        played -= *itr;
+    while (sound->passStarts.size() > 1 && sound->passStarts[1].read <= played)
+        sound->passStarts.pop_front();
+
+    char buf[32*1024];
+    unsigned int bsize = sizeof(buf) - sizeof(buf) % format.FrameSize();
+    while (!sound->idleBuffers.empty() && !sound->exhausted) {
+        unsigned int read = ReadChain(sound, buf, bsize);
+        if (read < bsize) 
+            sound->exhausted = true;
+        // an empty buffer would only be played through, keep it
+        // until there is data again
+        if (read == 0)
+            break;
+        ALuint buffer = sound->idleBuffers.back();
+        sound->idleBuffers.pop_back();
+        BufferData(buffer, format, buf, read, sound->frequency);
+        sound->last_offset += read;
+        alSourceQueueBuffers(source, 1, &buffer);
+        sound->queuedBuffers.push_back(buffer);
+        sound->queuedFrames.push_back(read / format.FrameSize());
+    }
+    CheckError("Error refilling stream: ");
+}
+
+/**
+ * Read the next data of a stream for a refill. At the end of a
+ * pass through the current stream the sound goes on with its queued
+ * streams, or starts over at the loop start when looping, so the
+ * data is contiguous either way. Queued streams are converted to
+ * the format of the sound, and a crossfade mixes the last frames of
+ * a stream with the first of the next. Short only when the last
+ * stream ends.
+ */
+unsigned int OpenALSoundSystem::ReadChain(OpenALStreamingSound* sound,
+                                          char* buf, unsigned int size) {
+    unsigned int frameSize = sound->format.FrameSize();
+    unsigned int frames = size / frameSize;
+    unsigned int count = 0;
+    bool rewound = false;
+    while (count < frames) {
+        char* out = buf + count * frameSize;
+        unsigned int want = frames - count;
+        // a loop end cuts the pass short, else it lasts until the
+        // resource runs out
+        unsigned int total = sound->resource->GetNumberOfSamples();
+        unsigned int passEnd = sound->looping ? sound->loopEnd : 0;
+        if (passEnd) total = passEnd;
+        OpenALStreamingSound::Segment* next = 
+            sound->playlist.empty() ? NULL : &sound->playlist.front();
+        unsigned int fade = 0;
+        if (next) fade = next->fadeFrames < total ? next->fadeFrames : total;
+        unsigned int fadeStart = total - fade;
+
+        if (fade == 0 || sound->segmentFrames < fadeStart) {
+            unsigned int stop = fade ? fadeStart : passEnd;
+            if (stop && sound->segmentFrames >= stop) {
+                if (!EndOfPass(sound, rewound)) break;
+                continue;
+            }
+            if (stop && want > stop - sound->segmentFrames)
+                want = stop - sound->segmentFrames;
+            unsigned int read = ReadSegment(sound, sound->resource, out, want);
+            sound->segmentFrames += read;
+            count += read;
+            sound->readFrames += read;
+            if (read) rewound = false;
+            if (read < want && !EndOfPass(sound, rewound))
+                break;
+            continue;
+        }
 
+        // both streams play through the crossfade
+        if (sound->segmentFrames >= total) {
+            NextSegment(sound);
+            continue;
         }
+        if (want > total - sound->segmentFrames)
+            want = total - sound->segmentFrames;
+        fadeOut.resize(want * frameSize);
+        fadeIn.resize(want * frameSize);
+        unsigned int outFrames = ReadSegment(sound, sound->resource, &fadeOut[0], want);
+        unsigned int inFrames = ReadSegment(sound, next->resource, &fadeIn[0], want);
+        unsigned int mixed = outFrames > inFrames ? outFrames : inFrames;
+        // pad the shorter one with silence, unsigned for 8 bit
+        char silence = sound->format.type == SampleFormat::INT8 ? (char)0x80 : 0;
+        memset(&fadeOut[0] + outFrames * frameSize, silence, (want - outFrames) * frameSize);
+        memset(&fadeIn[0] + inFrames * frameSize, silence, (want - inFrames) * frameSize);
+        MixCrossfade(sound, out, mixed, sound->segmentFrames - fadeStart, fade);
+        sound->segmentFrames += outFrames;
+        sound->incomingFrames += inFrames;
+        count += mixed;
+        sound->readFrames += mixed;
+        if (outFrames < want || sound->segmentFrames >= total)
+            NextSegment(sound);
+    }
+    return count * frameSize;
+}
+
+/**
+ * Move on from the end of a pass through the current stream.
+ * Returns false when the sound has no more data, which includes a
+ * loop that gave no frames since it last started over.
+ */
+bool OpenALSoundSystem::EndOfPass(OpenALStreamingSound* sound, bool& rewound) {
+    if (!sound->playlist.empty()) {
+        NextSegment(sound);
+        return true;
+    }
+    if (!sound->looping || rewound)
+        return false;
+    rewound = true;
+    return RewindStream(sound);
+}
+
+/**
+ * Start the stream over at its loop start. When reading ahead the
+ * reader does that on its workers, usually well before the end of
+ * the pass, so the next pass is in its ring already. Otherwise it
+ * is done here.
+ */
+bool OpenALSoundSystem::RewindStream(OpenALStreamingSound* sound) {
+    AttachReadAhead(sound);
+    stats.streamLoops++;
+    if (sound->readAhead) {
+        sound->segmentFrames = 
+            streamReader.NextPass(sound->readAhead, sound->loopStart);
+        sound->passStarts.push_back(OpenALStreamingSound::PassStart(
+            sound->readFrames, sound->segmentFrames));
+        // a loop start past the end ends the stream in the reader
+        return true;
+    }
+    sound->segmentFrames = RestartStream(sound, sound->loopStart);
+    sound->passStarts.push_back(OpenALStreamingSound::PassStart(
+        sound->readFrames, sound->segmentFrames));
+    // a loop start past the end leaves nothing to play
+    return sound->segmentFrames == sound->loopStart;
+}
+
+/**
+ * Go on reading the current stream of the sound from a frame.
+ * Resources cannot seek, so it is reloaded and read up to the
+ * frame, by the reader when the stream is read ahead. Returns the
+ * frame reached, short of the frame only if the stream ends first.
+ */
+unsigned int OpenALSoundSystem::RestartStream(OpenALStreamingSound* sound,
+                                              unsigned int frame) {
+    if (sound->readAhead) {
+        streamReader.Seek(sound->readAhead, frame);
+        return frame;
+    }
+    IStreamingSoundResourcePtr resource = sound->resource;
+    resource->Unload();
+    resource->Load();
+    unsigned int frameSize = SampleFormat::Of(resource).FrameSize();
+    unsigned int skip = frame;
+    chainScratch.resize(32*1024 - (32*1024) % frameSize);
+    while (skip > 0) {
+        unsigned int size = skip * frameSize;
+        if (size > chainScratch.size()) size = chainScratch.size();
+        unsigned int read = resource->GetBuffer(size, &chainScratch[0]) / frameSize;
+        if (read == 0) 
+            break;
+        skip -= read;
+    }
+    return frame - skip;
+}
+
+/**
+ * The frame of the current stream of the sound being played. The
+ * queued buffers hold the frames read ahead of it, which may span
+ * several passes through a loop, so the frame is found from the
+ * start of the pass the source is in.
+ */
+unsigned int OpenALSoundSystem::StreamPosition(OpenALStreamingSound* sound) {
+    unsigned int voice = sound->handle.index;
+    ALuint source = voices.source[voice];
+    ALint offset = 0, processed = 0, queued = 0, state = AL_INITIAL;
+    alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+
+    int64_t ahead = 0;
+    for (std::deque<unsigned int>::iterator itr = sound->queuedFrames.begin();
+         itr != sound->queuedFrames.end(); ++itr)
+        ahead += *itr;
+    // silence in front of a scheduled start is queued first
+    ALint pad = 0;
+    if (voices.pad[voice] && !sound->queuedFrames.empty())
+        pad = sound->queuedFrames.front();
+    ahead -= pad;
+    // a stopped source has played all it had queued
+    if (state == AL_STOPPED && processed == queued)
+        ahead = 0;
+    else if (offset > pad)
+        ahead -= offset - pad;
+    if (ahead < 0) ahead = 0;
+
+    uint64_t played = ahead < (int64_t)sound->readFrames 
+        ? sound->readFrames - ahead : 0;
+    std::deque<OpenALStreamingSound::PassStart>::reverse_iterator pass = 
+        sound->passStarts.rbegin();
+    while (pass != sound->passStarts.rend() && pass->read > played)
+        ++pass;
+    // not started on the stream yet
+    if (pass == sound->passStarts.rend())
+        return 0;
+    return pass->frame + (played - pass->read);
+}
+
+/**
+ * Move the sound to a frame of its current stream. The queued
+ * buffers are dropped and filled again from there, in this call,
+ * and the source is left playing or paused as it was. With nothing
+ * read ahead from the new frame yet, the refill reads the resource
+ * here.
+ */
+void OpenALSoundSystem::SeekStream(OpenALStreamingSound* sound,
+                                   unsigned int frame) {
+    unsigned int voice = sound->handle.index;
+    ALuint source = voices.source[voice];
+    if (!sound->warm)
+        WarmStream(sound);
+    ClearPad(voice);
+    ALint state = AL_INITIAL;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    sound->idleBuffers.insert(sound->idleBuffers.end(),
+                              sound->queuedBuffers.begin(),
+                              sound->queuedBuffers.end());
+    sound->queuedBuffers.clear();
+    sound->queuedFrames.clear();
+    sound->playedFrames = frame;
+
+    // the next stream may have given frames to a crossfade
+    if (sound->incomingFrames && !sound->playlist.empty()) {
+        IStreamingSoundResourcePtr next = sound->playlist.front().resource;
+        next->Unload();
+        next->Load();
+    }
+    sound->incomingFrames = 0;
+    sound->segmentFrames = RestartStream(sound, frame);
+    sound->readFrames = 0;
+    sound->passStarts.clear();
+    sound->passStarts.push_back(
+        OpenALStreamingSound::PassStart(0, sound->segmentFrames));
+    sound->exhausted = false;
+    RefillStream(voice, 0);
+
+    if (state == AL_PLAYING || state == AL_PAUSED)
+        alSourcePlay(source);
+    // culled voices are paused as well
+    if (state == AL_PAUSED)
+        alSourcePause(source);
+    CheckError("Error seeking stream: ");
+    SamplePosition(voice, timer.GetElapsedTime());
+}
+
+/**
+ * Read up to frames frames of a stream of the sound in the format
+ * of the sound. Only the current stream is read ahead.
+ */
+unsigned int OpenALSoundSystem::ReadSegment(OpenALStreamingSound* sound,
+                                            IStreamingSoundResourcePtr resource,
+                                            char* buf, unsigned int frames) {
+    SampleFormat from = SampleFormat::Of(resource);
+    bool current = resource == sound->resource;
+    if (from == sound->format) {
+        unsigned int size = frames * from.FrameSize();
+        unsigned int read = current ? ReadStream(sound, buf, size) 
+                                    : resource->GetBuffer(size, buf);
+        return read / from.FrameSize();
+    }
+    chainScratch.resize(frames * from.FrameSize());
+    if (chainScratch.empty())
+        return 0;
+    unsigned int read = current 
+        ? ReadStream(sound, &chainScratch[0], chainScratch.size())
+        : resource->GetBuffer(chainScratch.size(), &chainScratch[0]);
+    ConvertSamples(&chainScratch[0], read, from, sound->format, chainConverted);
+    if (!chainConverted.empty())
+        memcpy(buf, &chainConverted[0], chainConverted.size());
+    return chainConverted.size() / sound->format.FrameSize();
+}
+
+/**
+ * Mix the frames in fadeOut and fadeIn into buf with equal power
+ * gains, position frames into a crossfade of length frames. The
+ * float mix is done in mixOut and mixIn, which keep their capacity
+ * between refills.
+ */
+void OpenALSoundSystem::MixCrossfade(OpenALStreamingSound* sound, char* buf,
+                                     unsigned int frames, unsigned int position,
+                                     unsigned int length) {
+    if (frames == 0) 
+        return;
+    unsigned int channels = sound->format.channels;
+    SampleFormat mixFormat(channels, SampleFormat::FLOAT32);
+    unsigned int size = frames * sound->format.FrameSize();
+    ConvertSamples(&fadeOut[0], size, sound->format, mixFormat, mixOut);
+    ConvertSamples(&fadeIn[0], size, sound->format, mixFormat, mixIn);
+    float* o = (float*)&mixOut[0];
+    const float* in = (const float*)&mixIn[0];
+    for (unsigned int i = 0; i < frames; ++i) {
+        float t = (position + i + 0.5f) / length;
+        float gainOut = cos(t * PI * 0.5f);
+        float gainIn = sin(t * PI * 0.5f);
+        for (unsigned int c = 0; c < channels; ++c, ++o, ++in)
+            *o = *o * gainOut + *in * gainIn;
+    }
+    ConvertSamples(&mixOut[0], mixOut.size(), mixFormat, sound->format, chainConverted);
+    memcpy(buf, &chainConverted[0], chainConverted.size());
+}
 
-        timedExecutioner.Handle(arg);
+/**
+ * Make the first queued stream the current one. Frames it already
+ * gave to a crossfade count as read.
+ */
+void OpenALSoundSystem::NextSegment(OpenALStreamingSound* sound) {
+    if (sound->playlist.empty())
+        return;
+    if (sound->readAhead) {
+        streamReader.Detach(sound->readAhead);
+        sound->readAhead = NULL;
     }
+    sound->resource = sound->playlist.front().resource;
+    sound->playlist.pop_front();
+    sound->segmentFrames = sound->incomingFrames;
+    sound->passStarts.push_back(OpenALStreamingSound::PassStart(
+        sound->readFrames, sound->incomingFrames));
+    sound->incomingFrames = 0;
+    sound->length = sound->CalculateLength();
+    AttachReadAhead(sound);
+    stats.segmentsChained++;
+}
+
+void OpenALSoundSystem::Handle(Core::ProcessEventArg arg) {
+    if (!alcContext) 
+        return;
+    SampleLatency();
+    PollPads();
+    ScheduleRefills();
+    PollLevelSwitches();
+    UpdateSourceStates();
+    EvaluateDucking();
+    timedExecutioner.Handle(arg);
+    FlushErrors("process update");
+    DispatchSourceEvents();
 }
 
 void OpenALSoundSystem::Handle(Core::DeinitializeEventArg arg) {
+    while (!prefetches.empty())
+        DropPrefetch(prefetches.begin()->first);
+    decodeWorker.Stop();
+    streamReader.Stop();
+    if (hasEvents) {
+        ALenum types[3] = { AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT,
+                            AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT,
+                            AL_EVENT_TYPE_DISCONNECTED_SOFT };
+        alEventControlSOFT(3, types, AL_FALSE);
+        alEventCallbackSOFT(NULL, NULL);
+        hasEvents = false;
+    }
     alcMakeContextCurrent(NULL);
     if (alcContext != NULL) {
         alcDestroyContext(alcContext);
@@ -637,12 +3441,23 @@ void OpenALSoundSystem::Handle(Core::DeinitializeEventArg arg) {
 OpenALSoundSystem::OpenALStreamingSound::OpenALStreamingSound(IStreamingSoundResourcePtr resource,
                                                               OpenALSoundSystem* soundsystem)
      : resource(resource)
+     , format(SampleFormat::Of(resource))
+     , frequency(resource->GetFrequency())
      , soundsystem(soundsystem)                   
      , maxdist(1000.0)
-     , gain(10.0)
-     , pos(Vector<3,float>(0,0,0))
      , rel(false)
      , last_offset(0)
+     , exhausted(false)
+     , looping(false)
+     , lazy(false)
+     , warm(false)
+     , readAhead(NULL)
+     , playedFrames(0)
+     , segmentFrames(0)
+     , incomingFrames(0)
+     , readFrames(0)
+     , loopStart(0)
+     , loopEnd(0)
 {
 
 }
@@ -664,11 +3479,14 @@ unsigned int OpenALSoundSystem::OpenALStreamingSound::GetLengthInSamples() {
 }
 
 void OpenALSoundSystem::OpenALStreamingSound::SetElapsedSamples(unsigned int samples) {
-    DEBUG_ME();
+	if (!soundsystem->alcContext)
+		return;
+    soundsystem->SeekStream(this, samples);
 }
 unsigned int OpenALSoundSystem::OpenALStreamingSound::GetElapsedSamples() {
-    DEBUG_ME();
-    return 0;
+	if (!soundsystem->alcContext)
+		return 0;
+    return soundsystem->StreamPosition(this);
 }
 Time OpenALSoundSystem::OpenALStreamingSound::CalculateLength() {
     //@todo optimize these calculations
@@ -697,16 +3515,10 @@ Time OpenALSoundSystem::OpenALStreamingSound::GetLength() {
 }
 bool OpenALSoundSystem::OpenALStreamingSound::IsPlaying() {
 	if (!soundsystem->alcContext) return false;
-
-    ALint state = 0;
-    ALCenum error;
-    alGetSourcei(sourceID, AL_SOURCE_STATE, &state);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to get source state but got error: "
-                        + Convert::ToString(error));
-    }
-
-    return (state == AL_PLAYING);
+    return (soundsystem->voices.state[handle.index] == AL_PLAYING);
+}
+void OpenALSoundSystem::OpenALStreamingSound::Refresh() {
+    soundsystem->RefreshState(handle.index);
 }
 void OpenALSoundSystem::OpenALStreamingSound::SetLooping(bool loop) {
     if (loop) 
@@ -715,17 +3527,47 @@ void OpenALSoundSystem::OpenALStreamingSound::SetLooping(bool loop) {
         e.Notify(ALStreamEventArg(NO_LOOP, this));
 }
 bool OpenALSoundSystem::OpenALStreamingSound::GetLooping() {
-	if (!soundsystem->alcContext)
-		return false;
-
-    ALint loop;
-    ALCenum error;
-    alGetSourcei(sourceID, AL_LOOPING, &loop);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to get looping but got: "
-		      + Convert::ToString(error));
-    }
-    return (loop != AL_FALSE);
+    return looping;
+}
+IEvent<SoundEventArg>& OpenALSoundSystem::OpenALStreamingSound::SoundEvent() {
+    return soundEvent;
+}
+void OpenALSoundSystem::OpenALStreamingSound::Enqueue(IStreamingSoundResourcePtr next,
+                                                      Time crossfade) {
+    if (next->GetFrequency() != frequency)
+        throw Exception("queued streams must have the sample rate of the sound");
+    // other layouts are folded to stereo as they are read
+    unsigned int channels = SampleFormat::Of(next).channels;
+    if (channels != format.channels &&
+        (format.channels != 2 || channels == 0 ||
+         channels > SampleFormat::MAX_CHANNELS))
+        throw Exception("queued streams must have the channels of the sound");
+    int64_t fade = crossfade.AsInt64();
+    if (fade < 0) fade = 0;
+    playlist.push_back(Segment(next, fade * frequency / 1000000));
+    // a finished sound plays the new stream when played again
+    exhausted = false;
+}
+void OpenALSoundSystem::OpenALStreamingSound::ClearQueue() {
+    playlist.clear();
+    incomingFrames = 0;
+}
+unsigned int OpenALSoundSystem::OpenALStreamingSound::GetQueueLength() {
+    return playlist.size();
+}
+void OpenALSoundSystem::OpenALStreamingSound::SetLoopPoints(unsigned int start,
+                                                            unsigned int end) {
+    if (end && end <= start)
+        throw Exception("loop end must come after loop start");
+    loopStart = start;
+    loopEnd = end;
+    soundsystem->SetReadAheadLoop(this);
+}
+unsigned int OpenALSoundSystem::OpenALStreamingSound::GetLoopStart() {
+    return loopStart;
+}
+unsigned int OpenALSoundSystem::OpenALStreamingSound::GetLoopEnd() {
+    return loopEnd;
 }
 bool OpenALSoundSystem::OpenALStreamingSound::IsStereoSound() {
     DEBUG_ME();
@@ -737,7 +3579,9 @@ bool OpenALSoundSystem::OpenALStreamingSound::IsMonoSound() {
 }
 
 void OpenALSoundSystem::OpenALStreamingSound::SetElapsedTime(Time time) {
-    DEBUG_ME();
+	if (!soundsystem->alcContext)
+		return;
+    SetElapsedSamples((unsigned int)(time.AsInt64() * frequency / 1000000));
 }
 Time OpenALSoundSystem::OpenALStreamingSound::GetElapsedTime() {
 	if (!soundsystem->alcContext)
@@ -761,8 +3605,7 @@ Time OpenALSoundSystem::OpenALStreamingSound::GetElapsedTime() {
     // freq /= gcd;
     // factor /= gcd;
     // return Time(sec, (sampleCount*factor)/freq); //@todo save this calc!
-    float t; 
-    alGetSourcef(sourceID, AL_SEC_OFFSET, &t);
+    double t = soundsystem->voices.playOffset[handle.index];
     // logger.info << "t: " << t << logger.end;
     uint64_t s = t;
     // logger.info << "s: " << s << logger.end;
@@ -771,21 +3614,23 @@ Time OpenALSoundSystem::OpenALStreamingSound::GetElapsedTime() {
     // logger.info << "us: " << us << logger.end;
     return Time(s,us);
 }
+double OpenALSoundSystem::OpenALStreamingSound::GetPlaybackPosition() {
+    return clock.Read(soundsystem->timer.GetElapsedTime());
+}
+double OpenALSoundSystem::OpenALStreamingSound::GetOutputLatency() {
+    return clock.GetLatency();
+}
 void OpenALSoundSystem::OpenALStreamingSound::SetGain(float gain) {
-    this->gain = gain;
+    soundsystem->voices.gain[handle.index] = gain;
 	if (!soundsystem->alcContext)
 		return;
 
-    ALCenum error;
-    alSourcef(sourceID, AL_GAIN, (ALfloat)gain);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to set gain but got: "
-		      + Convert::ToString(error));
-    }
+    soundsystem->ApplyGain(handle.index);
+    soundsystem->CheckError("tried to set gain but got: ");
 
 }
 float OpenALSoundSystem::OpenALStreamingSound::GetGain() {
-    return this->gain;
+    return soundsystem->voices.gain[handle.index];
 }
 
 
@@ -796,9 +3641,9 @@ OpenALSoundSystem::OpenALMonoSound::OpenALMonoSound(ISoundResourcePtr resource,
     : resource(resource)
     , soundsystem(soundsystem)
     , maxdist(1000.0)
-    , gain(10.0)
-    , pos(Vector<3,float>(0.0,0.0,0.0))
     , rel(false)
+    , looping(false)
+    , stereo(NULL)
 {}
     
 
@@ -820,15 +3665,11 @@ void OpenALSoundSystem::OpenALMonoSound::Pause() {
 
 bool OpenALSoundSystem::OpenALMonoSound::IsPlaying() {
 	if (!soundsystem->alcContext) return false;
+    return (soundsystem->voices.state[handle.index] == AL_PLAYING);
+}
 
-    ALint state = 0;
-    ALCenum error;
-    alGetSourcei(sourceID, AL_SOURCE_STATE, &state);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to get source state but got error: "
-                        + Convert::ToString(error));
-    }
-    return (state == AL_PLAYING);
+void OpenALSoundSystem::OpenALMonoSound::Refresh() {
+    soundsystem->RefreshState(handle.index);
 }
 
 unsigned int OpenALSoundSystem::OpenALMonoSound::GetLengthInSamples() {
@@ -863,50 +3704,52 @@ Time OpenALSoundSystem::OpenALMonoSound::GetLength() {
 
 void OpenALSoundSystem::OpenALMonoSound::SetRelativePosition(bool rel) {
     this->rel = rel;
+    // relative sounds follow the listener and are never culled
+    if (!stereo) {
+        if (rel && soundsystem->voices.culled[handle.index])
+            soundsystem->UncullVoice(handle.index);
+        soundsystem->SetSpatial(handle.index, !rel);
+    }
 	if (!soundsystem->alcContext)
 		return;
 
-    ALCenum error;
-    alSourcei(sourceID, AL_SOURCE_RELATIVE, rel);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-        throw Exception("tried to set source relative but got: "
-                        + Convert::ToString(error));
-    }
+    alSourcei(soundsystem->voices.source[handle.index], AL_SOURCE_RELATIVE, rel);
+    soundsystem->CheckError("tried to set source relative but got: ");
 
 }
 
 void OpenALSoundSystem::OpenALMonoSound::SetPosition(Vector<3,float> pos) {
-    this->pos = pos;
-    soundsystem->UpdatePosition(this);
+    soundsystem->voices.position[handle.index] = pos;
+    soundsystem->UpdatePosition(handle.index);
 }
 
 Vector<3,float> OpenALSoundSystem::OpenALMonoSound::GetPosition() {
-    return pos;
+    return soundsystem->voices.position[handle.index];
 }
 
 ISoundResourcePtr OpenALSoundSystem::OpenALMonoSound::GetResource() {
     return resource;
 }
 
+IEvent<SoundEventArg>& OpenALSoundSystem::OpenALMonoSound::SoundEvent() {
+    return soundEvent;
+}
+
 unsigned int OpenALSoundSystem::OpenALMonoSound::GetID() {
-    return sourceID;
+    return soundsystem->voices.source[handle.index];
 }
 
 void OpenALSoundSystem::OpenALMonoSound::SetGain(float gain) {
-    this->gain = gain;
+    soundsystem->voices.gain[handle.index] = gain;
 	if (!soundsystem->alcContext)
 		return;
 
-    ALCenum error;
-    alSourcef(sourceID, AL_GAIN, (ALfloat)gain);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to set gain but got: "
-		      + Convert::ToString(error));
-    }
+    soundsystem->ApplyGain(handle.index);
+    soundsystem->CheckError("tried to set gain but got: ");
 }
 
 float OpenALSoundSystem::OpenALMonoSound::GetGain() {
-    return gain;
+    return soundsystem->voices.gain[handle.index];
 }
 
 void OpenALSoundSystem::OpenALMonoSound::SetLooping(bool loop) {
@@ -917,43 +3760,25 @@ void OpenALSoundSystem::OpenALMonoSound::SetLooping(bool loop) {
 }
 
 bool OpenALSoundSystem::OpenALMonoSound::GetLooping() {
-	if (!soundsystem->alcContext)
-		return false;
-
-    ALint loop;
-    ALCenum error;
-    alGetSourcei(sourceID, AL_LOOPING, &loop);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to get looping but got: "
-		      + Convert::ToString(error));
-    }
-    return (loop != AL_FALSE);
+    return looping;
 }
 
 void OpenALSoundSystem::OpenALMonoSound::SetElapsedSamples(unsigned int samples) {
 	if (!soundsystem->alcContext)
 		return;
 
-    ALCenum error;
-    alSourcei(sourceID, AL_SAMPLE_OFFSET, (ALint)samples);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to set offset by sample but got: "
-		      + Convert::ToString(error));
-    }
+    // the bound buffer may be at another rate than the resource
+    float seconds = (float)samples / resource->GetFrequency();
+    alSourcef(soundsystem->voices.source[handle.index], AL_SEC_OFFSET, seconds);
+    soundsystem->CheckError("tried to set offset by sample but got: ");
+    soundsystem->RefreshState(handle.index);
 }
 
 unsigned int OpenALSoundSystem::OpenALMonoSound::GetElapsedSamples() {
 	if (!soundsystem->alcContext)
 		return 0;
-
-    ALint samples;
-    ALCenum error;
-    alGetSourcei(sourceID, AL_SAMPLE_OFFSET, &samples);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to get offset by sample but got: "
-		      + Convert::ToString(error));
-    }
-    return samples;
+    return (unsigned int)(soundsystem->voices.secOffset[handle.index] * 
+                          resource->GetFrequency() + 0.5);
 }
 
 void OpenALSoundSystem::OpenALMonoSound::SetElapsedTime(Time time) {
@@ -961,12 +3786,9 @@ void OpenALSoundSystem::OpenALMonoSound::SetElapsedTime(Time time) {
 		return;
     
     float seconds = ((float)time.AsInt())/1000000.0;
-    ALCenum error;
-    alSourcef(sourceID, AL_SEC_OFFSET, (ALfloat)seconds);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to set offset by seconds but got: "
-		      + Convert::ToString(error));
-    }
+    alSourcef(soundsystem->voices.source[handle.index], AL_SEC_OFFSET, (ALfloat)seconds);
+    soundsystem->CheckError("tried to set offset by seconds but got: ");
+    soundsystem->RefreshState(handle.index);
 }
 
 Time OpenALSoundSystem::OpenALMonoSound::GetElapsedTime() {
@@ -991,8 +3813,7 @@ Time OpenALSoundSystem::OpenALMonoSound::GetElapsedTime() {
     // freq /= gcd;
     // factor /= gcd;
     // return Time(sec, (sampleCount*factor)/freq); //@todo save this calc!
-    float t; 
-    alGetSourcef(sourceID, AL_SEC_OFFSET, &t);
+    double t = soundsystem->voices.playOffset[handle.index];
     // logger.info << "t: " << t << logger.end;
     uint64_t s = t;
     // logger.info << "s: " << s << logger.end;
@@ -1002,16 +3823,23 @@ Time OpenALSoundSystem::OpenALMonoSound::GetElapsedTime() {
     return Time(s,us);
 }
 
+double OpenALSoundSystem::OpenALMonoSound::GetPlaybackPosition() {
+    return clock.Read(soundsystem->timer.GetElapsedTime());
+}
+
+double OpenALSoundSystem::OpenALMonoSound::GetOutputLatency() {
+    return clock.GetLatency();
+}
+
 void OpenALSoundSystem::OpenALMonoSound::SetMaxDistance(float distance) {
     maxdist = distance;
-	if (!soundsystem->alcContext)
+    soundsystem->voices.maxDistance[handle.index] = distance;
+    if (distance > soundsystem->cullRange)
+        soundsystem->cullRange = distance;
+    if (!soundsystem->alcContext)
         return;
-    ALCenum error;
-    alSourcef(sourceID, AL_MAX_DISTANCE, (ALfloat)distance);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to set max distance but got: "
-		      + Convert::ToString(error));
-    }
+    alSourcef(soundsystem->voices.source[handle.index], AL_MAX_DISTANCE, (ALfloat)distance);
+    soundsystem->CheckError("tried to set max distance but got: ");
 }
 
 float OpenALSoundSystem::OpenALMonoSound::GetMaxDistance() {
@@ -1023,14 +3851,10 @@ void OpenALSoundSystem::OpenALMonoSound::SetVelocity(Vector<3,float> vel) {
 	if (!soundsystem->alcContext)
 		return;
 
-    ALCenum error;
     ALfloat v[3];
     vel.ToArray(v);
     // @todo: salomon alSourcefv(sourceID, AL_VELOCITY, v);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to set velocity but got: "
-		      + Convert::ToString(error));
-    }
+    soundsystem->CheckError("tried to set velocity but got: ");
     //logger.info << "source vel: " << vel << logger.end;
 }
 
@@ -1040,12 +3864,8 @@ Vector<3,float> OpenALSoundSystem::OpenALMonoSound::GetVelocity() {
 
     ALfloat v[3];
     v[0] = v[1] = v[2] = 0;
-    ALCenum error;
     // @todo: salomon alGetSourcefv(sourceID, AL_VELOCITY, v);
-    if ((error = alGetError()) != AL_NO_ERROR) {
-      throw Exception("tried to get offset by time but got: "
-		      + Convert::ToString(error));
-    }
+    soundsystem->CheckError("tried to get offset by time but got: ");
     return Vector<3,float>(v[0],v[1],v[2]);
 }
 
@@ -1059,37 +3879,21 @@ OpenALSoundSystem::OpenALStereoSound::OpenALStereoSound(ISoundResourcePtr resour
 
     // hvorfor laver openal en kopi af lydfilen?
 
+    // throws on sample types without a buffer format
+    SampleFormat stereo = SampleFormat::Of(res);
+    unsigned int bits = res->GetBitsPerSample();
+
     char* leftbuffer = new char[res->GetBufferSize()/2]; // <--
     char* rightbuffer = new char[res->GetBufferSize()/2]; 
 
-    char* data = res->GetBuffer();    	  	
-
-    if (res->GetBitsPerSample() == 8) {
-		
-        for (unsigned int i=0; i < (res->GetBufferSize())/2; i++) 
-            { 
-                leftbuffer[i] = data[i*2]; // left chan
-                rightbuffer[i] = data[i*2+1]; // right chan 
-            } 
+    char* channels[2] = { leftbuffer, rightbuffer };
+    SampleKernels::Deinterleaver(stereo)(res->GetBuffer(), channels,
+                                         res->GetBufferSize() / stereo.FrameSize());
 
-        left = new OpenALMonoSound(ISoundResourcePtr(new CustomSoundResource(leftbuffer, res->GetBufferSize()/2, res->GetFrequency(), MONO, 8)), soundsystem);
-        right = new OpenALMonoSound(ISoundResourcePtr(new CustomSoundResource(rightbuffer, res->GetBufferSize()/2, res->GetFrequency(), MONO, 8)), soundsystem);
-    }
-    else if (res->GetBitsPerSample() == 16) {
-		
-        int j = 0;
-        for (unsigned int i=0; i < (res->GetBufferSize()); i += 4)  
-            { 			
-                leftbuffer[j] = data[i]; // left chan
-                leftbuffer[j+1] = data[i+1]; // left chan
-                rightbuffer[j] = data[i+2]; // right chan 
-                rightbuffer[j+1] = data[i+3]; // right chan 
-                j += 2;
-            } 
-
-        left = new OpenALMonoSound(ISoundResourcePtr(new CustomSoundResource(leftbuffer, res->GetBufferSize()/2, res->GetFrequency(), MONO, 16)), soundsystem);
-        right = new OpenALMonoSound(ISoundResourcePtr(new CustomSoundResource(rightbuffer, res->GetBufferSize()/2, res->GetFrequency(), MONO, 16)),soundsystem);
-    }
+    left = new OpenALMonoSound(ISoundResourcePtr(new CustomSoundResource(leftbuffer, res->GetBufferSize()/2, res->GetFrequency(), MONO, bits)), soundsystem);
+    right = new OpenALMonoSound(ISoundResourcePtr(new CustomSoundResource(rightbuffer, res->GetBufferSize()/2, res->GetFrequency(), MONO, bits)), soundsystem);
+    left->stereo = this;
+    right->stereo = this;
 }
 
 OpenALSoundSystem::OpenALStereoSound::~OpenALStereoSound() {
@@ -1151,6 +3955,14 @@ Time OpenALSoundSystem::OpenALStereoSound::GetElapsedTime() {
 //         throw Exception("left and right channels is out of sync");
     return left->GetElapsedTime();
 }
+
+double OpenALSoundSystem::OpenALStereoSound::GetPlaybackPosition() {
+    return left->GetPlaybackPosition();
+}
+
+double OpenALSoundSystem::OpenALStereoSound::GetOutputLatency() {
+    return left->GetOutputLatency();
+}
   
 void OpenALSoundSystem::OpenALStereoSound::Play() {
     e.Notify(ALStereoEventArg(PLAY, this));
@@ -1165,11 +3977,19 @@ void OpenALSoundSystem::OpenALStereoSound::Pause() {
 }
 
 bool OpenALSoundSystem::OpenALStereoSound::IsPlaying() {
-    if (left->IsPlaying() != right->IsPlaying())
-        throw Exception("left and right channel state is out of sync");
+    // the channels are stopped together, see SourceStopped
     return left->IsPlaying();
 }
 
+void OpenALSoundSystem::OpenALStereoSound::Refresh() {
+    left->Refresh();
+    right->Refresh();
+}
+
+IEvent<SoundEventArg>& OpenALSoundSystem::OpenALStereoSound::SoundEvent() {
+    return soundEvent;
+}
+
 IMonoSound* OpenALSoundSystem::OpenALStereoSound::GetLeft() {
 	return left;
 }
@@ -1209,7 +4029,7 @@ OpenALSoundSystem::CustomSoundResource::CustomSoundResource(char* data, unsigned
 }
 
 OpenALSoundSystem::CustomSoundResource::~CustomSoundResource() {
-
+    delete[] data;
 }
 
 void OpenALSoundSystem::CustomSoundResource::Load() {
@@ -24,14 +24,29 @@
 #include <Core/IModule.h>
 #include <Core/QueuedEvent.h>
 #include <Core/IListener.h>
+#include <Core/Mutex.h>
 #include <Scene/SoundNode.h>
 #include <Sound/IMonoSound.h>
 #include <Sound/IStereoSound.h>
+#include <Sound/IStreamingSound.h>
+#include <Sound/SoundHandle.h>
 #include <Sound/SoundNodeVisitor.h>
+#include <Sound/SpatialGrid.h>
+#include <Sound/PlaybackClock.h>
+#include <Sound/DecodeWorker.h>
+#include <Sound/StreamReader.h>
+#include <Sound/Resampler.h>
+#include <Sound/ConversionCache.h>
+#include <Sound/SampleFormat.h>
+#include <Sound/AdpcmEncoder.h>
+#include <Sound/CompressedClip.h>
+#include <Sound/SoundBank.h>
 #include <Resources/ISoundResource.h>
 #include <Resources/IStreamingSoundResource.h>
 
+#include <deque>
 #include <list>
+#include <map>
 #include <set>
 #include <vector>
 #include <string>
@@ -43,6 +58,7 @@ namespace Sound {
 using OpenEngine::Core::IModule;
 using OpenEngine::Core::QueuedEvent;
 using OpenEngine::Core::IListener;
+using OpenEngine::Core::Mutex;
 using OpenEngine::Display::IViewingVolume;
 using OpenEngine::Math::Vector;
 using OpenEngine::Math::Quaternion;
@@ -56,6 +72,17 @@ using std::set;
 using std::vector;
 using std::string;
 using std::queue;
+using std::multimap;
+using std::pair;
+
+// Default error checking policy, see OpenALSoundSystem::ErrorPolicy.
+#ifndef OE_OPENAL_ERROR_POLICY
+#ifdef NDEBUG
+#define OE_OPENAL_ERROR_POLICY ERRORS_DEFERRED
+#else
+#define OE_OPENAL_ERROR_POLICY ERRORS_STRICT
+#endif
+#endif
 
 class ALMonoEventArg;
 class ALStereoEventArg;
@@ -68,6 +95,134 @@ class OpenALSoundSystem : public ISoundSystem
     friend class ALMonoEventArg;
     friend class ALStereoEventArg;
     friend class ALStreamEventArg;
+public:
+    /**
+     * How OpenAL errors are checked.
+     * ERRORS_STRICT checks after every call and throws an exception
+     * naming the failing call. ERRORS_DEFERRED checks once at the end
+     * of each update and logs the failing batch. ERRORS_OFF never
+     * checks. Release builds default to deferred checking.
+     */
+    enum ErrorPolicy {
+        ERRORS_STRICT, ERRORS_DEFERRED, ERRORS_OFF
+    };
+
+    /**
+     * Sound system counters.
+     */
+    class Stats {
+    public:
+        unsigned int errors;    //!< number of OpenAL errors seen
+        ALenum lastError;       //!< the most recent error code
+        string lastErrorBatch;  //!< where the most recent error was seen
+        unsigned int oneShots;        //!< one-shots played
+        unsigned int oneShotsDropped; //!< one-shots without a free voice
+        unsigned int playsRejected;   //!< plays refused by an instance policy
+        unsigned int playsStolen;     //!< instances stopped to make room
+        unsigned int voicesCulled;    //!< voices paused beyond max distance
+        unsigned int prefetchIssued;  //!< stream prefetches started
+        unsigned int prefetchHits;    //!< streams started from a prefetch
+        unsigned int prefetchMisses;  //!< streams decoded on play
+        unsigned int prefetchDropped; //!< prefetches thrown away unused
+        unsigned int lodSwitches;     //!< buffer switches between detail levels
+        unsigned int resampled;       //!< buffers resampled to the device rate
+        unsigned int resampleCacheHits; //!< resampled buffers read from disk
+        unsigned int compressedBuffers; //!< buffers uploaded as ADPCM
+        unsigned int compressedBytesSaved; //!< 16 bit PCM bytes not uploaded
+        unsigned int clipsStatic;     //!< clips created fully decoded
+        unsigned int clipsCompressed; //!< clips created as compressed streams
+        unsigned int buffersShared;   //!< resources given an identical buffer
+        unsigned int bytesShared;     //!< sample bytes not uploaded again
+        unsigned int streamsReadAhead;   //!< streams attached to the reader
+        unsigned int readAheadUnderruns; //!< refills read on the frame
+        unsigned int refillDeadlinesMissed; //!< refills after a stream ran dry
+        unsigned int refillsDeferred;  //!< refills left for the next update
+        unsigned int segmentsChained;  //!< queued streams started
+        unsigned int streamLoops;      //!< streams rewound to loop
+        unsigned int playsScheduled;   //!< plays started on the device clock
+        unsigned int playsPadded;      //!< plays delayed by silence
+        Stats(): errors(0), lastError(AL_NO_ERROR)
+               , oneShots(0), oneShotsDropped(0)
+               , playsRejected(0), playsStolen(0), voicesCulled(0)
+               , prefetchIssued(0), prefetchHits(0), prefetchMisses(0)
+               , prefetchDropped(0), lodSwitches(0)
+               , resampled(0), resampleCacheHits(0)
+               , compressedBuffers(0), compressedBytesSaved(0)
+               , clipsStatic(0), clipsCompressed(0)
+               , buffersShared(0), bytesShared(0)
+               , streamsReadAhead(0), readAheadUnderruns(0)
+               , refillDeadlinesMissed(0), refillsDeferred(0)
+               , segmentsChained(0), streamLoops(0)
+               , playsScheduled(0), playsPadded(0) {}
+    };
+
+    typedef unsigned int BusID;
+    static const BusID MASTER_BUS = 0;
+
+    /**
+     * Attributes the context is created with. Zero leaves the
+     * frequency, the mixer updates per second (ALC_REFRESH) and the
+     * number of mono and stereo sources to the driver, as does
+     * DRIVER_DEFAULT for HRTF and the output limiter, which need
+     * ALC_SOFT_HRTF and ALC_SOFT_output_limiter. A higher refresh
+     * means smaller updates and less latency.
+     */
+    class ContextConfig {
+    public:
+        enum Switch {
+            DRIVER_DEFAULT, ENABLED, DISABLED
+        };
+        unsigned int frequency;
+        unsigned int refresh;
+        unsigned int monoSources;
+        unsigned int stereoSources;
+        Switch hrtf;
+        Switch limiter;
+        ContextConfig(): frequency(0), refresh(0)
+                       , monoSources(0), stereoSources(0)
+                       , hrtf(DRIVER_DEFAULT), limiter(DRIVER_DEFAULT) {}
+    };
+
+    /**
+     * How CreateClip keeps a resource. Clips decoding to at most
+     * staticLimit bytes, and clips played at least hotPlays times
+     * within the last hotWindow, get a static buffer. Larger, colder
+     * clips are kept IMA ADPCM compressed in memory and decoded as
+     * they stream, and their decoded data is unloaded if
+     * unloadDecoded is set.
+     */
+    class ClipPolicy {
+    public:
+        unsigned int staticLimit;
+        float hotPlays;
+        Time hotWindow;
+        bool unloadDecoded;
+        ClipPolicy(): staticLimit(512 * 1024), hotPlays(4.0)
+                    , hotWindow(60, 0), unloadDecoded(true) {}
+    };
+
+    /**
+     * Limits on how many instances of a resource play at once.
+     * When maxInstances are playing, a new play either stops the
+     * oldest or the quietest instance, or is rejected. Plays closer
+     * than minRetrigger to the previous one are always rejected.
+     * Zero means no limit.
+     */
+    class InstancePolicy {
+    public:
+        enum Steal {
+            REJECT, STEAL_OLDEST, STEAL_QUIETEST
+        };
+        unsigned int maxInstances;
+        Steal steal;
+        Time minRetrigger;
+        InstancePolicy(unsigned int maxInstances = 0, 
+                       Steal steal = REJECT,
+                       Time minRetrigger = Time(0,0))
+            : maxInstances(maxInstances), steal(steal)
+            , minRetrigger(minRetrigger) {}
+    };
+
 private:
 
     // ISceneNode* root;
@@ -78,6 +233,12 @@ private:
     ALCcontext* alcContext;
     vector<string> devices;
     unsigned int device;
+    ContextConfig contextConfig;
+    Time deviceLatency;
+    unsigned int latencyProbes;
+    vector<ALCint> ContextAttributes();
+    void ProbeLatency();
+    void SampleLatency();
     
     SoundNodeVisitor visitor;
     TimedExecutioner<float> timedExecutioner;
@@ -85,25 +246,143 @@ private:
 
     inline void MakeDeviceList();
 
+    ErrorPolicy errorPolicy;
+    Stats stats;
+    Utils::Timer timer;
+    Vector<3,float> listenerPos;
+    void ReportError(ALenum error, const char* what);
+    void FlushErrors(const char* batch);
+    inline void CheckError(const char* what) {
+        if (errorPolicy != ERRORS_STRICT) return;
+        ALenum error = alGetError();
+        if (error != AL_NO_ERROR) 
+            ReportError(error, what);
+    }
+
+    // AL_SOFT_events support. The callback is invoked from the mixer
+    // thread, so it only records the event and leaves dispatching to
+    // the process loop.
+    class PendingALEvent {
+    public:
+        ALenum type;
+        ALuint object;
+        ALuint param;
+        PendingALEvent(ALenum type, ALuint object, ALuint param)
+            : type(type), object(object), param(param) {}
+    };
+    bool hasEvents;
+    LPALEVENTCONTROLSOFT alEventControlSOFT;
+    LPALEVENTCALLBACKSOFT alEventCallbackSOFT;
+    Mutex eventLock;
+    vector<PendingALEvent> pendingEvents;
+    vector<PendingALEvent> receivedEvents;
+    Event<SoundEventArg> soundEvent;
+    static void AL_APIENTRY EventCallback(ALenum eventType, ALuint object,
+                                          ALuint param, ALsizei length,
+                                          const ALchar* message,
+                                          void* userParam);
+    inline void InitEvents();
+
+    // ALC_SOFT_device_clock and AL_SOFT_source_start_delay support,
+    // see PlayAt. Without them starts are delayed by a buffer of
+    // silence queued ahead of the sound.
+    LPALCGETINTEGER64VSOFT alcGetInteger64vSOFT;
+    LPALSOURCEPLAYATTIMEVSOFT alSourcePlayAtTimevSOFT;
+    // AL_SOFT_source_latency, for offsets in double precision along
+    // with the output latency
+    LPALGETSOURCEDVSOFT alGetSourcedvSOFT;
+    void SamplePosition(unsigned int voice, Time now);
+    vector<unsigned int> paddedVoices;
+    void InitClock();
+    ALuint MakeSilence(ALuint like, Time length);
+    void PadVoice(unsigned int voice, Time delay);
+    void ClearPad(unsigned int voice);
+    void PollPads();
+
+    class OpenALMonoSound;
+    class OpenALStereoSound;
+    class OpenALStreamingSound;
+
+    // Voices are the OpenAL sources owned by the sounds. They live in
+    // a generational slot map, and the fields touched every update
+    // are stored as parallel arrays indexed by slot. A slot is live
+    // while it has an owner.
+    class VoiceTable {
+    public:
+        vector<unsigned int> generation;
+        vector<ALuint> source;
+        vector<ALuint> buffer;
+        vector<float> gain;
+        vector<Vector<3,float> > position;
+        vector<ALint> state;
+        vector<ALint> sampleOffset;
+        vector<float> secOffset;
+        // seconds into the sound in double precision, for streams
+        // counting the buffers already played
+        vector<double> playOffset;
+        vector<char> active;
+        vector<char> listed;
+        vector<char> oneShot;
+        vector<float> maxDistance;
+        // instance group membership, a list in start order
+        vector<int> group;
+        vector<int> groupPrev;
+        vector<int> groupNext;
+        // mix bus and position in the bus' voice list
+        vector<unsigned int> bus;
+        vector<int> busSlot;
+        vector<char> busPaused;
+        // positional voices in the emitter grid, and the ones paused
+        // for being out of range
+        vector<char> spatial;
+        vector<char> culled;
+        vector<unsigned int> audibleFrame;
+        // the cull pass the voice is listed in cullCheck for
+        vector<unsigned int> checkFrame;
+        vector<Time> cullTime;
+        vector<float> length;
+        // detail level of the bound buffer, and the level queued to
+        // follow the current pass or -1, see LODSet
+        vector<unsigned char> lod;
+        vector<signed char> lodNext;
+        // silence queued ahead of a scheduled start
+        vector<ALuint> pad;
+        vector<double> padLength;
+        vector<ISound*> owner;
+        vector<OpenALMonoSound*> mono;
+        vector<OpenALStreamingSound*> stream;
+        vector<unsigned int> freeSlots;
+
+        SoundHandle Allocate(ISound* owner, OpenALMonoSound* mono,
+                             OpenALStreamingSound* stream);
+        void Release(SoundHandle handle);
+        bool IsValid(SoundHandle handle) const;
+        unsigned int Size() const;
+    };
+    VoiceTable voices;
+
     class OpenALMonoSound: public IMonoSound {
     public:
 
     private:
-        ALuint sourceID;
-        ALuint bufferID;
+        SoundHandle handle;
 
         ISoundResourcePtr resource;
         OpenALSoundSystem* soundsystem;
 
         // state
         float maxdist;
-        float gain;
-        Vector<3,float> pos;
         bool rel;
+        bool looping;
+
+        // set when this is a channel of a stereo sound
+        OpenALStereoSound* stereo;
+        PlaybackClock clock;
         
         Time length;
         Time CalculateLength();
         Event<ALMonoEventArg> e;
+        Event<SoundEventArg> soundEvent;
         friend class OpenALSoundSystem;
     public:
         OpenALMonoSound(ISoundResourcePtr resource, OpenALSoundSystem* soundsystem);
@@ -132,6 +411,10 @@ private:
         void SetPosition(Vector<3,float> pos);
         void SetRelativePosition(bool rel);
         ISoundResourcePtr GetResource();
+        double GetPlaybackPosition();
+        double GetOutputLatency();
+        IEvent<SoundEventArg>& SoundEvent();
+        void Refresh();
     };
 
 	class OpenALStereoSound : public IStereoSound {
@@ -141,6 +424,7 @@ private:
         OpenALSoundSystem* soundsystem;
         ISoundResourcePtr res;
         Event<ALStereoEventArg> e;
+        Event<SoundEventArg> soundEvent;
         friend class OpenALSoundSystem;
      public:
         OpenALStereoSound(ISoundResourcePtr resource, OpenALSoundSystem* soundsystem);
@@ -168,23 +452,74 @@ private:
 
         void SetElapsedTime(Time time);
         Time GetElapsedTime();
+
+        double GetPlaybackPosition();
+        double GetOutputLatency();
+
+        IEvent<SoundEventArg>& SoundEvent();
+        void Refresh();
     };
 
-    class OpenALStreamingSound : public ISound {
+    class OpenALStreamingSound : public IStreamingSound {
     private:
-        ALuint sourceID;
+        SoundHandle handle;
         vector<ALuint> bufferIDs;
         Time length;
         IStreamingSoundResourcePtr resource;
+        // format of the source queue, the one of the first resource
+        SampleFormat format;
+        unsigned int frequency;
         OpenALSoundSystem *soundsystem;
         Event<ALStreamEventArg> e;
+        Event<SoundEventArg> soundEvent;
 
         float maxdist;
-        float gain;
-        Vector<3,float> pos;
         bool rel;
 
         int last_offset;
+        // the resource returned no more data
+        bool exhausted;
+        bool looping;
+        // positional streams are decoded when played or prefetched,
+        // warm once their first buffers are queued
+        bool lazy;
+        bool warm;
+        // the data read ahead of the refills
+        ReadAheadStream* readAhead;
+        // the queued buffers and their frames, oldest first
+        std::deque<ALuint> queuedBuffers;
+        std::deque<unsigned int> queuedFrames;
+        // frames of the buffers played and unqueued
+        uint64_t playedFrames;
+        PlaybackClock clock;
+
+        // resources to play after this one, see ReadChain
+        class Segment {
+        public:
+            IStreamingSoundResourcePtr resource;
+            unsigned int fadeFrames;
+            Segment(IStreamingSoundResourcePtr resource, unsigned int fadeFrames)
+                : resource(resource), fadeFrames(fadeFrames) {}
+        };
+        std::deque<Segment> playlist;
+        // frames read of the resource, and of the next one fading in
+        unsigned int segmentFrames;
+        unsigned int incomingFrames;
+        // frames read into the queue, and where in them each pass
+        // through a stream starts, oldest first, see StreamPosition
+        class PassStart {
+        public:
+            uint64_t read;
+            unsigned int frame;
+            PassStart(uint64_t read, unsigned int frame)
+                : read(read), frame(frame) {}
+        };
+        uint64_t readFrames;
+        std::deque<PassStart> passStarts;
+        unsigned int loopStart;
+        unsigned int loopEnd;
+        // buffers left unqueued when the stream ran out of data
+        vector<ALuint> idleBuffers;
 
         friend class OpenALSoundSystem;
     public:
@@ -218,6 +553,20 @@ private:
 
         Time CalculateLength();
 
+        IEvent<SoundEventArg>& SoundEvent();
+        void Refresh();
+
+        void Enqueue(IStreamingSoundResourcePtr resource,
+                     Time crossfade = Time(0,0));
+        void ClearQueue();
+        unsigned int GetQueueLength();
+
+        void SetLoopPoints(unsigned int start, unsigned int end = 0);
+        unsigned int GetLoopStart();
+        unsigned int GetLoopEnd();
+
+        double GetPlaybackPosition();
+        double GetOutputLatency();
     };
 
 	class CustomSoundResource : public ISoundResource {
@@ -240,11 +589,279 @@ private:
 			~CustomSoundResource();
 
 	};
-    list<OpenALMonoSound*> monos;
-    list<OpenALStereoSound*> stereos;
-    list<OpenALStreamingSound*> streams;
 
-    set<OpenALStreamingSound*> playingStreams;
+    // references from voices to each AL buffer
+    map<ALuint, unsigned int> bufferRefs;
+
+    // static buffers by a hash of their resource's samples, format
+    // and upload options. The resource is kept to verify matches, so
+    // like the key in buffers it stays alive until its buffer is
+    // deleted and ForgetBuffer drops both.
+    class ContentEntry {
+    public:
+        ALuint buffer;
+        ISoundResourcePtr resource;
+        bool compressed;
+        unsigned int rate;  // the device rate if resampled, else its own
+        bool lod;           // whether detail levels were made
+        ContentEntry(ALuint buffer, ISoundResourcePtr resource, bool compressed,
+                     unsigned int rate, bool lod)
+            : buffer(buffer), resource(resource), compressed(compressed)
+            , rate(rate), lod(lod) {}
+    };
+    multimap<uint64_t, ContentEntry> contentBuffers;
+    ALuint FindIdenticalBuffer(uint64_t hash, const ContentEntry& wanted);
+    void ForgetBuffer(ALuint buffer);
+
+    // voices reserved for PlayOneShot, and the ones not playing
+    unsigned int oneShotVoices;
+    vector<unsigned int> oneShotPool;
+    vector<unsigned int> freeOneShots;
+    void GrowOneShotPool(unsigned int count);
+    void ReserveVoiceLists();
+    inline void RecycleOneShot(unsigned int voice);
+
+    // the playing instances of a resource with an instance policy
+    class InstanceGroup {
+    public:
+        InstancePolicy policy;
+        int head;
+        int tail;
+        unsigned int count;
+        bool started;
+        Time lastStart;
+        InstanceGroup(InstancePolicy policy)
+            : policy(policy), head(-1), tail(-1), count(0)
+            , started(false) {}
+    };
+    vector<InstanceGroup> groups;
+    map<ISoundResource*, unsigned int> groupIndex;
+    bool AdmitInstance(unsigned int voice, ISoundResource* resource);
+    void JoinGroup(unsigned int voice, unsigned int group);
+    void LeaveGroup(unsigned int voice);
+    void StealVoice(unsigned int voice);
+    float Loudness(unsigned int voice);
+
+    class MixBus {
+    public:
+        string name;
+        BusID parent;
+        float gain;
+        float duck;      // attenuation from the ducking rules
+        float effective; // gain times the parents' effective gain
+        unsigned int playing; // playing voices on the bus and below
+        bool compress;   // upload new buffers of the bus as ADPCM
+        vector<BusID> children;
+        vector<unsigned int> voices;
+        MixBus(string name, BusID parent, float effective, bool compress)
+            : name(name), parent(parent), gain(1.0), duck(1.0)
+            , effective(effective), playing(0), compress(compress) {}
+    };
+    vector<MixBus> buses;
+    map<string, BusID> busNames;
+    vector<unsigned int> busVoices;
+    vector<ALuint> busSources;
+    void AssignBus(unsigned int voice, BusID bus);
+    void RemoveFromBus(unsigned int voice);
+    void CollectBusVoices(BusID bus, vector<unsigned int>& out);
+    void UpdateBusGain(BusID bus);
+    void ApplyGain(unsigned int voice);
+    void CountPlaying(BusID bus, int delta);
+
+    // the duck level is ramped by the timed executioner
+    class DuckingRule : public RWValue<float> {
+    public:
+        OpenALSoundSystem* system;
+        BusID trigger;
+        BusID target;
+        float attenuation;
+        Time attack;
+        Time release;
+        bool triggered;
+        float level; // 0 is no ducking, 1 is full attenuation
+        DuckingRule(OpenALSoundSystem* system, BusID trigger, BusID target,
+                    float attenuation, Time attack, Time release)
+            : system(system), trigger(trigger), target(target)
+            , attenuation(attenuation), attack(attack), release(release)
+            , triggered(false), level(0.0) {}
+        float Get() { return level; }
+        void Set(float value) { 
+            level = value; 
+            system->UpdateDucking(target); 
+        }
+    };
+    vector<DuckingRule*> duckingRules;
+    void EvaluateDucking();
+    void UpdateDucking(BusID bus);
+
+    // emitter positions, used to pause voices beyond their max
+    // distance and resume them where they would have been
+    SpatialGrid emitters;
+    bool culling;
+    float cullRange;
+    unsigned int cullFrame;
+    vector<unsigned int> cullCandidates;
+    vector<unsigned int> cullCheck;
+    vector<unsigned int> cullExpiry;
+    void SetSpatial(unsigned int voice, bool spatial);
+    void CullVoices();
+    void CullVoice(unsigned int voice);
+    void UncullVoice(unsigned int voice);
+    void ExpireCulledVoices();
+    float BufferLength(ALuint buffer);
+
+    // static buffers converted to the mixing rate of the device
+    bool resampleToDevice;
+    ALCint deviceFrequency;
+    ConversionCache conversionCache;
+    void ConvertToDeviceRate(const char* data, unsigned int size,
+                             unsigned int bits, unsigned int channels,
+                             unsigned int frequency, vector<char>& out);
+
+    // AL buffer format of each channel count and sample type, zero
+    // where the device has none and the data is converted instead
+    ALenum alFormats[SampleFormat::MAX_CHANNELS + 1][3];
+    vector<char> formatScratch;
+    void InitFormats();
+    ALenum ResolveFormat(SampleFormat format, SampleFormat& upload);
+    void BufferData(ALuint buffer, SampleFormat format, const char* data,
+                    unsigned int size, unsigned int frequency);
+
+    // static buffers kept IMA ADPCM encoded, chosen per resource or
+    // by the bus of the sound that first uploads the resource
+    ALenum ima4Formats[3];
+    map<ISoundResource*, bool> compression;
+    bool UploadCompressed(ALuint buffer, SampleFormat format, const char* data,
+                          unsigned int size, unsigned int frequency);
+    void EncodeAdpcm(SampleFormat format, const char* data, unsigned int size,
+                     vector<char>& encoded);
+
+    // sizes and play rate of the resources given to CreateClip, and
+    // their encoded data once a clip of them has been compressed
+    class ClipUsage {
+    public:
+        unsigned int decodedSize;
+        unsigned int frequency;
+        unsigned int channels;
+        unsigned int frames;
+        float heat;
+        Time lastPlay;
+        bool unloaded;
+        ClipDataPtr data;
+        ClipUsage(): decodedSize(0), frequency(0), channels(0), frames(0)
+                   , heat(0.0), unloaded(false) {}
+    };
+    ClipPolicy clipPolicy;
+    map<ISoundResource*, ClipUsage> clipUsage;
+
+    // one resource per bank clip, so its sounds share a buffer
+    map<const SoundBank::Entry*, ISoundResourcePtr> bankResources;
+    float ClipHeat(ClipUsage& usage);
+    void NoteClipPlay(ISoundResource* resource);
+
+    // Lower rate copies of a mono buffer, keyed by the full rate
+    // buffer. Level n holds every 2^n'th sample, played at the
+    // rounded rate kept with it.
+    class LODSet {
+    public:
+        ALuint buffers[3];
+        ALint frequency[3];
+    };
+    map<ALuint, LODSet> lodSets;
+    bool lodEnabled;
+    float lodDistance[2];
+    vector<unsigned int> lodSwitching;
+    void CreateLODSet(ALuint buffer, const char* data, unsigned int size,
+                      unsigned int bits, unsigned int frequency);
+    void DeleteLODSet(ALuint buffer);
+    unsigned char LevelFor(float distanceSquared, unsigned char level);
+    ALuint StartLevel(unsigned int voice);
+    void BindLevel(unsigned int voice);
+    void UpdateLevelOfDetail(unsigned int voice, float distanceSquared);
+    void PollLevelSwitches();
+    ALint BaseOffset(unsigned int voice, ALint offset);
+
+    // positional streams, and the first buffers decoded for the
+    // ones the listener is heading towards
+    class Prefetch {
+    public:
+        DecodeJob* job;
+        Time wanted;
+        Prefetch(DecodeJob* job, Time wanted): job(job), wanted(wanted) {}
+    };
+    DecodeWorker decodeWorker;
+    SpatialGrid streamEmitters;
+    map<IStreamingSoundResource*, Prefetch> prefetches;
+    Time prefetchHorizon;
+    unsigned int prefetchLimit;
+    Time listenerTime;
+    Vector<3,float> listenerVelocity;
+    vector<unsigned int> streamCandidates;
+    void PredictPrefetches();
+    void DropPrefetch(IStreamingSoundResource* resource);
+    void WarmStream(OpenALStreamingSound* sound);
+
+    StreamReader streamReader;
+    Time readAheadTime;
+    unsigned int streamWorkers;
+    void AttachReadAhead(OpenALStreamingSound* sound);
+    void SetReadAheadLoop(OpenALStreamingSound* sound);
+    unsigned int ReadStream(OpenALStreamingSound* sound, char* buf, 
+                            unsigned int size);
+    vector<char> chainScratch;
+    vector<char> chainConverted;
+    vector<char> fadeIn;
+    vector<char> fadeOut;
+    vector<char> mixIn;
+    vector<char> mixOut;
+    unsigned int ReadChain(OpenALStreamingSound* sound, char* buf,
+                           unsigned int size);
+    unsigned int ReadSegment(OpenALStreamingSound* sound,
+                             IStreamingSoundResourcePtr resource,
+                             char* buf, unsigned int frames);
+    void MixCrossfade(OpenALStreamingSound* sound, char* buf,
+                      unsigned int frames, unsigned int position,
+                      unsigned int length);
+    void NextSegment(OpenALStreamingSound* sound);
+    bool EndOfPass(OpenALStreamingSound* sound, bool& rewound);
+    bool RewindStream(OpenALStreamingSound* sound);
+    unsigned int RestartStream(OpenALStreamingSound* sound, unsigned int frame);
+    unsigned int StreamPosition(OpenALStreamingSound* sound);
+    void SeekStream(OpenALStreamingSound* sound, unsigned int frame);
+    void QueueStreamBuffers(OpenALStreamingSound* sound);
+
+    // streams with played buffers, refilled earliest deadline first
+    // within the refill budget
+    class StreamRefill {
+    public:
+        unsigned int voice;
+        ALint processed;
+        int64_t deadline;
+        StreamRefill(unsigned int voice, ALint processed, int64_t deadline)
+            : voice(voice), processed(processed), deadline(deadline) {}
+        bool operator<(const StreamRefill& other) const {
+            return deadline < other.deadline;
+        }
+    };
+    vector<StreamRefill> streamRefills;
+    Time refillBudget;
+    void ScheduleRefills();
+    void RefillStream(unsigned int voice, ALint processed);
+
+    // voices whose state is captured each update, see
+    // UpdateSourceStates. Entries are dropped lazily.
+    vector<unsigned int> activeVoices;
+    map<ALuint, unsigned int> sourceIndex;
+
+    class FiredEvent {
+    public:
+        Event<SoundEventArg>* event;
+        SoundEventArg arg;
+        bool cancelled;
+        FiredEvent(Event<SoundEventArg>* event, SoundEventArg arg)
+            : event(event), arg(arg), cancelled(false) {}
+    };
+    vector<FiredEvent> firedEvents;
 
     map<ISoundResourcePtr, ALuint> buffers;
     map<IStreamingSoundResourcePtr, vector<ALuint> > bufferList;
@@ -252,12 +869,21 @@ private:
     queue<ALStereoEventArg> stereoActions;
     queue<ALStreamEventArg> streamActions;
 
-    inline void InitResource(ISoundResourcePtr resource);
-    inline void InitResource(IStreamingSoundResourcePtr resource);
+    inline void InitResource(ISoundResourcePtr resource, BusID bus = MASTER_BUS);
+    inline void InitResource(IStreamingSoundResourcePtr resource, 
+                             DecodeJob* prefetched = NULL);
     inline void InitSound(OpenALStreamingSound* sound);
     inline void InitSound(OpenALMonoSound* sound);
-    void UpdatePosition(OpenALMonoSound* sound);
-    void UpdatePosition(OpenALStreamingSound* sound);
+    void UpdatePosition(unsigned int voice);
+    inline void SetSourceState(unsigned int voice, ALint state);
+    void ReleaseVoice(SoundHandle handle);
+    void CancelEvents(ISound* sound);
+    void RefreshState(unsigned int index);
+    void UpdateSourceStates();
+    void SourceStopped(unsigned int index);
+    void DispatchSourceEvents();
+    void FireEvent(SoundEventArg::Type type, OpenALMonoSound* sound);
+    void FireEvent(SoundEventArg::Type type, OpenALStreamingSound* sound);
 
 public:
     OpenALSoundSystem(/*ISceneNode* root, IViewingVolume* vv*/);
@@ -265,6 +891,179 @@ public:
 
     ISound* CreateSound(ISoundResourcePtr resource);
     ISound* CreateSound(IStreamingSoundResourcePtr resource);
+    void DestroySound(ISound* sound);
+    bool PlayOneShot(ISoundResourcePtr resource, Vector<3,float> position,
+                     float gain = 1.0, float pitch = 1.0);
+    void SetOneShotVoices(unsigned int count);
+    unsigned int GetOneShotVoices();
+
+    void SetInstancePolicy(ISoundResourcePtr resource, InstancePolicy policy);
+    void ClearInstancePolicy(ISoundResourcePtr resource);
+
+    /**
+     * Mix buses group sounds under the master bus. A sound's gain is
+     * multiplied by the gain of its bus and all buses above it.
+     * Pause, resume and stop act on a bus and everything below it
+     * with a single call into OpenAL.
+     */
+    BusID CreateBus(string name, BusID parent = MASTER_BUS);
+    BusID GetBus(string name);
+    void SetBusGain(BusID bus, float gain);
+    float GetBusGain(BusID bus);
+    void PauseBus(BusID bus);
+    void ResumeBus(BusID bus);
+    void StopBus(BusID bus);
+
+    /**
+     * While any sound on the trigger bus plays, the target bus is
+     * ramped down to attenuation times its gain over the attack
+     * time, and back up over the release time once it stops.
+     */
+    void AddDuckingRule(BusID trigger, BusID target, float attenuation,
+                        Time attack, Time release);
+    void ClearDuckingRules();
+
+    /**
+     * Distance culling pauses positional sounds farther from the
+     * listener than their max distance, and resumes them at the
+     * offset they would have reached once they are in range again.
+     */
+    void SetDistanceCulling(bool enabled);
+    bool GetDistanceCulling();
+    void SetCullingCellSize(float size);
+    //! Sounds within radius of center.
+    void QueryRadius(Vector<3,float> center, float radius, 
+                     vector<SoundHandle>& out);
+    //! The count sounds nearest to center within radius, nearest first.
+    void QueryNearest(Vector<3,float> center, unsigned int count,
+                      float radius, vector<SoundHandle>& out);
+
+    /**
+     * Positional streams decode their first buffers when played, or
+     * ahead of time in the background when the listener is predicted
+     * to get within their max distance inside the prefetch horizon.
+     */
+    ISound* CreateSound(IStreamingSoundResourcePtr resource, 
+                        Vector<3,float> position, BusID bus = MASTER_BUS);
+    void SetStreamPosition(ISound* sound, Vector<3,float> position);
+    void SetPrefetchHorizon(Time horizon);
+    Time GetPrefetchHorizon();
+    void SetPrefetchLimit(unsigned int streams);
+
+    /**
+     * Playing streams are read ahead by a background thread, so the
+     * refills of the process loop copy from memory instead of
+     * waiting on the resource. Each stream buffers the given time of
+     * its data, at least 64 KB. A zero time reads streams started
+     * afterwards on the frame, as before.
+     */
+    void SetStreamReadAhead(Time time);
+    Time GetStreamReadAhead();
+    //! Threads reading streams ahead, two by default.
+    void SetStreamWorkers(unsigned int threads);
+
+    /**
+     * Each update refills the streams in order of the time left
+     * before their sources run dry, and stops once the refills have
+     * taken the budget, leaving the rest for the next update. The
+     * most urgent stream is always refilled. A zero budget refills
+     * all streams every update.
+     */
+    void SetRefillBudget(Time budget);
+    Time GetRefillBudget();
+
+    /**
+     * Resample static sounds to the rate of the device when their
+     * buffer is created, so OpenAL mixes them without resampling.
+     * Results are cached in the given directory across runs, keyed
+     * by a hash of the sample data.
+     */
+    void SetResampleToDevice(bool enabled, string cacheDirectory = "");
+    bool GetResampleToDevice();
+    unsigned int GetDeviceFrequency();
+
+    /**
+     * Whether the device takes the format as is. Float and more than
+     * two channels need AL_EXT_FLOAT32 and AL_EXT_MCFORMATS, without
+     * them the data is converted to 16 bit and mixed down to stereo.
+     */
+    bool IsNativeFormat(SampleFormat format);
+
+    /**
+     * Upload static sounds as IMA ADPCM where the device has
+     * AL_EXT_IMA4, at about a quarter of the 16 bit size. The
+     * resource setting wins over the bus setting, and both apply to
+     * buffers created afterwards. Other devices get PCM. Encoded
+     * data is kept in the resample cache directory when one is set.
+     */
+    void SetCompression(ISoundResourcePtr resource, bool compressed);
+    void SetBusCompression(BusID bus, bool compressed);
+    bool IsCompressionSupported();
+
+    /**
+     * Create a sound from a resource, choosing between a static
+     * buffer and a compressed in-memory stream by the clip policy.
+     * Plays of sounds made this way count towards the play rate.
+     */
+    ISound* CreateClip(ISoundResourcePtr resource, BusID bus = MASTER_BUS);
+
+    /**
+     * Create a sound from a clip in a mapped sound bank. PCM clips
+     * get a static buffer shared by all sounds of the clip, ADPCM
+     * clips are streamed from the mapping. Throws if the bank has no
+     * such clip.
+     */
+    ISound* CreateSound(SoundBankPtr bank, string name, BusID bus = MASTER_BUS);
+    void SetClipPolicy(ClipPolicy policy);
+    ClipPolicy GetClipPolicy();
+
+    /**
+     * Level of detail plays positional mono sounds from copies of
+     * their buffer at half the rate beyond the first distance, and
+     * at a quarter of the rate in 8 bit beyond the second. Only
+     * buffers created while it is enabled get the copies. Sounds get
+     * the level for their distance when they start, and looping
+     * sounds move between levels at the end of a pass, so a source
+     * is never restarted for a switch.
+     */
+    void SetLevelOfDetail(bool enabled, float halfRateDistance = 250.0,
+                          float quarterRateDistance = 600.0);
+    bool GetLevelOfDetail();
+
+    ISound* CreateSound(ISoundResourcePtr resource, BusID bus);
+    ISound* CreateSound(IStreamingSoundResourcePtr resource, BusID bus);
+
+    /**
+     * The clock of the output device, or of the sound system when
+     * the device has none.
+     */
+    Time GetDeviceTime();
+    bool IsScheduledPlaySupported();
+
+    /**
+     * Start a sound at a time of the device clock, rather than in
+     * the update that applies the play. With AL_SOFT_source_start_delay
+     * the mixer starts it on the exact sample. Otherwise the sound is
+     * played at once behind a buffer of silence lasting until the
+     * time, which fails only for ADPCM buffers, and which restarts
+     * the current buffer of a stream that was already playing. The
+     * channels of a stereo sound start together either way.
+     */
+    void PlayAt(ISound* sound, Time deviceTime);
+    //! Start a sound offset from the device time now.
+    void PlayAfter(ISound* sound, Time offset);
+    bool PlayOneShot(ISoundResourcePtr resource, Vector<3,float> position,
+                     BusID bus, float gain, float pitch);
+
+    /**
+     * Handle based access to the sounds.
+     * Handles stay safe to use after the sound is destroyed: they
+     * are then reported as invalid and GetSound returns NULL.
+     */
+    SoundHandle GetHandle(ISound* sound);
+    ISound* GetSound(SoundHandle handle);
+    bool IsValid(SoundHandle handle);
+    void DestroySound(SoundHandle handle);
     // void SetRoot(ISceneNode* node);
 	void SetMasterGain(float gain);
 	float GetMasterGain();
@@ -273,10 +1072,44 @@ public:
     string GetDeviceName(unsigned int device);
     void SetDevice(unsigned int device);
 
+    /**
+     * Set the attributes of the context. Takes effect when the
+     * sound system is initialized, and is ignored by a driver that
+     * cannot create a context with it.
+     */
+    void SetContextConfig(ContextConfig config);
+    ContextConfig GetContextConfig();
+    /**
+     * The time from mixing a sample to hearing it, measured with
+     * ALC_SOFT_device_clock on initialization and over the first few
+     * process updates after it, keeping the largest. Without it this
+     * is the length of one mixer update, which the latency is at least.
+     */
+    Time GetDeviceLatency();
+
+    /**
+     * Event raised for every sound event in the system, and for
+     * device disconnects which do not belong to any sound.
+     */
+    IEvent<SoundEventArg>& SoundEvent();
+
+    void SetErrorPolicy(ErrorPolicy policy);
+    ErrorPolicy GetErrorPolicy();
+    Stats GetStats();
+    void ResetStats();
+
     void Handle(Core::InitializeEventArg arg);
     void Handle(Core::ProcessEventArg arg);
     void Handle(Core::DeinitializeEventArg arg);
     void Handle(RenderingEventArg arg);
+    /**
+     * The listener part of a rendering update: move the listener,
+     * cull distant sounds and predict stream prefetches. Handling a
+     * rendering event visits the scene and calls this with the
+     * viewing volume of the canvas, an application or tool without a
+     * canvas can call it once per frame itself.
+     */
+    void UpdateListener(Vector<3,float> position, Quaternion<float> direction);
 
     void Handle(ALMonoEventArg e);
     void Handle(ALStereoEventArg e);
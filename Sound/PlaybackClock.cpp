@@ -0,0 +1,76 @@
+// Smoothed playback position of a sound.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/PlaybackClock.h>
+
+#include <cmath>
+
+namespace OpenEngine {
+namespace Sound {
+
+const double PlaybackClock::SNAP = 0.1;
+// errors are gone after about this many seconds
+const double PlaybackClock::SLEW = 0.25;
+
+PlaybackClock::PlaybackClock()
+    : anchor(0,0), position(0.0), rate(0.0), latency(0.0) {}
+
+// called with the lock held
+double PlaybackClock::Predict(Time now) {
+    if (now <= anchor) 
+        return position;
+    return position + rate * ((now - anchor).AsInt64() / 1000000.0);
+}
+
+void PlaybackClock::Update(Time now, double heard, double latency,
+                           bool running) {
+    lock.Lock();
+    double predicted = Predict(now);
+    double error = heard - predicted;
+    if (!running) {
+        position = heard;
+        rate = 0.0;
+    }
+    else if (rate == 0.0 || fabs(error) > SNAP) {
+        position = heard;
+        rate = 1.0;
+    }
+    else {
+        position = predicted;
+        rate = 1.0 + error / SLEW;
+        if (rate < 0.95) rate = 0.95;
+        if (rate > 1.05) rate = 1.05;
+    }
+    anchor = now;
+    this->latency = latency;
+    lock.Unlock();
+}
+
+void PlaybackClock::Reset() {
+    lock.Lock();
+    position = rate = latency = 0.0;
+    lock.Unlock();
+}
+
+double PlaybackClock::Read(Time now) {
+    lock.Lock();
+    double p = Predict(now);
+    lock.Unlock();
+    return p;
+}
+
+double PlaybackClock::GetLatency() {
+    lock.Lock();
+    double l = latency;
+    lock.Unlock();
+    return l;
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,63 @@
+// Smoothed playback position of a sound.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_PLAYBACK_CLOCK_H_
+#define _OE_PLAYBACK_CLOCK_H_
+
+#include <Core/Mutex.h>
+#include <Utils/Timer.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Core::Mutex;
+using OpenEngine::Utils::Time;
+
+/**
+ * Playback clock.
+ * Turns the positions sampled from the driver once per update into
+ * a position that can be read at any time, from any thread, without
+ * asking the driver. Between samples the clock runs at the playback
+ * rate. Small errors are slewed away by running it slightly faster
+ * or slower, so it never steps backwards while playing. Errors
+ * larger than SNAP seconds, from seeks, loops and restarts, are
+ * taken at once.
+ *
+ * @class PlaybackClock PlaybackClock.h Sound/PlaybackClock.h
+ */
+class PlaybackClock {
+private:
+    static const double SNAP;
+    static const double SLEW;
+
+    Mutex lock;
+    Time anchor;      // when the position was last corrected
+    double position;  // seconds heard at the anchor
+    double rate;      // seconds of sound per second, 0 when stopped
+    double latency;
+
+    double Predict(Time now);
+
+public:
+    PlaybackClock();
+
+    //! Correct the clock with a position heard at time now.
+    void Update(Time now, double heard, double latency, bool running);
+    void Reset();
+
+    //! Seconds of the sound heard at time now.
+    double Read(Time now);
+    //! Seconds from mixing a sample to hearing it, at the last update.
+    double GetLatency();
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_PLAYBACK_CLOCK_H_
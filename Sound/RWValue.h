@@ -17,6 +17,7 @@ template <class T>
 class RWValue {
 public:
     RWValue() {}
+    virtual ~RWValue() {}
     virtual T Get() = 0;
     virtual void Set(T) = 0;
 };    
@@ -0,0 +1,81 @@
+// Sample rate conversion of PCM data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/Resampler.h>
+
+#include <cmath>
+#include <stdint.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+const unsigned int Resampler::TAPS;
+const unsigned int Resampler::PHASES;
+
+Resampler::Resampler(unsigned int inRate, unsigned int outRate)
+    : inRate(inRate), outRate(outRate), filter(PHASES * TAPS) {
+    const double pi = 3.14159265358979323846;
+    // cut off a little below the lower Nyquist frequency
+    double cutoff = 0.95 * (outRate < inRate ? (double)outRate / inRate : 1.0);
+    const int half = TAPS / 2;
+    for (unsigned int p = 0; p < PHASES; ++p) {
+        double frac = (double)p / PHASES;
+        double sum = 0.0;
+        for (unsigned int k = 0; k < TAPS; ++k) {
+            // distance from the output position to input sample k
+            double x = (double)k - (half - 1) - frac;
+            double sinc = (x == 0.0) ? 1.0 : sin(pi * cutoff * x) / (pi * cutoff * x);
+            // Blackman window over the filter length
+            double w = (x + half) / TAPS;
+            double window = 0.42 - 0.5 * cos(2 * pi * w) + 0.08 * cos(4 * pi * w);
+            double h = cutoff * sinc * window;
+            filter[p * TAPS + k] = (float)h;
+            sum += h;
+        }
+        // unity gain at DC for every phase
+        for (unsigned int k = 0; k < TAPS; ++k)
+            filter[p * TAPS + k] = (float)(filter[p * TAPS + k] / sum);
+    }
+}
+
+unsigned int Resampler::OutputFrames(unsigned int frames) const {
+    return (unsigned int)(((uint64_t)frames * outRate) / inRate);
+}
+
+void Resampler::Process(const short* in, unsigned int frames,
+                        unsigned int channels, std::vector<short>& out) const {
+    const unsigned int half = TAPS / 2;
+    unsigned int outFrames = OutputFrames(frames);
+    out.resize(outFrames * channels);
+
+    // one channel at a time, padded with silence on both sides
+    std::vector<float> padded(frames + TAPS);
+    for (unsigned int c = 0; c < channels; ++c) {
+        for (unsigned int i = 0; i < frames; ++i)
+            padded[i + half - 1] = in[i * channels + c];
+
+        for (unsigned int j = 0; j < outFrames; ++j) {
+            uint64_t pos = (uint64_t)j * inRate;
+            unsigned int i = (unsigned int)(pos / outRate);
+            unsigned int phase = (unsigned int)((pos % outRate) * PHASES / outRate);
+            const float* h = &filter[phase * TAPS];
+            const float* x = &padded[i];
+            float acc = 0.0f;
+            for (unsigned int k = 0; k < TAPS; ++k)
+                acc += x[k] * h[k];
+            int sample = (int)floorf(acc + 0.5f);
+            if (sample > 32767) sample = 32767;
+            if (sample < -32768) sample = -32768;
+            out[j * channels + c] = (short)sample;
+        }
+    }
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,50 @@
+// Sample rate conversion of PCM data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_RESAMPLER_H_
+#define _OE_RESAMPLER_H_
+
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+/**
+ * Resampler.
+ * Converts interleaved 16 bit PCM between sample rates with a
+ * polyphase windowed sinc filter. The filter cuts off below the
+ * lower of the two Nyquist frequencies, so downsampling does not
+ * alias. The inner loop is a plain dot product over contiguous
+ * floats, which compilers vectorize.
+ *
+ * @class Resampler Resampler.h Sound/Resampler.h
+ */
+class Resampler {
+private:
+    static const unsigned int TAPS = 32;    // filter length
+    static const unsigned int PHASES = 256; // fractional positions
+
+    unsigned int inRate;
+    unsigned int outRate;
+    std::vector<float> filter; // PHASES rows of TAPS coefficients
+
+public:
+    Resampler(unsigned int inRate, unsigned int outRate);
+
+    //! Number of frames produced from frames input frames.
+    unsigned int OutputFrames(unsigned int frames) const;
+
+    void Process(const short* in, unsigned int frames,
+                 unsigned int channels, std::vector<short>& out) const;
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_RESAMPLER_H_
@@ -0,0 +1,68 @@
+// Layout of interleaved sample data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/SampleFormat.h>
+#include <Sound/SampleKernels.h>
+
+#include <Core/Exceptions.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Core::Exception;
+using namespace OpenEngine::Resources;
+
+const unsigned int SampleFormat::MAX_CHANNELS;
+
+static SampleFormat::Type TypeOf(unsigned int bits) {
+    switch (bits) {
+    case 8:  return SampleFormat::INT8;
+    case 16: return SampleFormat::INT16;
+    case 32: return SampleFormat::FLOAT32;
+    }
+    throw Exception("unknown number of bits per sample");
+}
+
+template <class R>
+static unsigned int ChannelsOf(R* resource) {
+    IChannelLayout* layout = dynamic_cast<IChannelLayout*>(resource);
+    if (layout)
+        return layout->GetChannels();
+    return resource->GetFormat() == STEREO ? 2 : 1;
+}
+
+SampleFormat SampleFormat::Of(ISoundResourcePtr resource) {
+    return SampleFormat(ChannelsOf(resource.get()),
+                        TypeOf(resource->GetBitsPerSample()));
+}
+
+SampleFormat SampleFormat::Of(IStreamingSoundResourcePtr resource) {
+    return SampleFormat(ChannelsOf(resource.get()),
+                        TypeOf(resource->GetBitsPerSample()));
+}
+
+void ConvertSamples(const char* in, unsigned int size,
+                    SampleFormat from, SampleFormat to,
+                    std::vector<char>& out) {
+    if (from.channels == 0 || from.channels > SampleFormat::MAX_CHANNELS)
+        throw Exception("unsupported number of channels");
+    unsigned int frames = size / from.FrameSize();
+    out.resize(frames * to.FrameSize());
+    char* o = out.empty() ? NULL : &out[0];
+    if (from.channels == to.channels) {
+        SampleKernels::Converter(from.type, to.type)(in, o, frames * from.channels);
+        return;
+    }
+    if (to.channels != 2)
+        throw Exception("can only convert channels to stereo");
+    SampleKernels::Downmixer(from, to.type)(in, o, frames);
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,85 @@
+// Layout of interleaved sample data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_SAMPLE_FORMAT_H_
+#define _OE_SAMPLE_FORMAT_H_
+
+#include <Resources/ISoundResource.h>
+#include <Resources/IStreamingSoundResource.h>
+
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Resources::ISoundResourcePtr;
+using OpenEngine::Resources::IStreamingSoundResourcePtr;
+
+/**
+ * Implemented by sound resources with more channels than
+ * SoundFormat can name. Channels are interleaved in the OpenAL
+ * order: front left, front right, center, LFE, then the rear and
+ * side channels.
+ */
+class IChannelLayout {
+public:
+    virtual ~IChannelLayout() {}
+    virtual unsigned int GetChannels() = 0;
+};
+
+/**
+ * Sample format.
+ * Channel count and sample type of interleaved sample data. 8 bit
+ * samples are unsigned, 16 bit signed and 32 bit float, as OpenAL
+ * expects them.
+ *
+ * @class SampleFormat SampleFormat.h Sound/SampleFormat.h
+ */
+class SampleFormat {
+public:
+    enum Type { INT8, INT16, FLOAT32 };
+    static const unsigned int MAX_CHANNELS = 8;
+
+    unsigned int channels;
+    Type type;
+
+    SampleFormat(unsigned int channels = 1, Type type = INT16)
+        : channels(channels), type(type) {}
+
+    unsigned int BytesPerSample() const {
+        return type == INT8 ? 1 : (type == INT16 ? 2 : 4);
+    }
+    unsigned int FrameSize() const {
+        return channels * BytesPerSample();
+    }
+    bool operator==(const SampleFormat& f) const {
+        return channels == f.channels && type == f.type;
+    }
+    bool operator!=(const SampleFormat& f) const {
+        return !(*this == f);
+    }
+
+    //! Format of a resource, throws on bit depths without a type.
+    static SampleFormat Of(ISoundResourcePtr resource);
+    static SampleFormat Of(IStreamingSoundResourcePtr resource);
+};
+
+/**
+ * Convert interleaved samples between formats. Matching channel
+ * counts are kept, others are folded to stereo by the downmix
+ * kernels, see SampleKernels.
+ */
+void ConvertSamples(const char* in, unsigned int size,
+                    SampleFormat from, SampleFormat to,
+                    std::vector<char>& out);
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_SAMPLE_FORMAT_H_
@@ -0,0 +1,138 @@
+// Specialized loops over interleaved sample data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/SampleKernels.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+template <> const float Fold<1>::weights[1][2] = { {1,1} };
+template <> const float Fold<2>::weights[2][2] = { {1,0}, {0,1} };
+template <> const float Fold<3>::weights[3][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f} };
+// quad: FL FR RL RR
+template <> const float Fold<4>::weights[4][2] =
+    { {1,0}, {0,1}, {0.707f,0}, {0,0.707f} };
+template <> const float Fold<5>::weights[5][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0.707f,0}, {0,0.707f} };
+// 5.1: FL FR FC LFE RL RR
+template <> const float Fold<6>::weights[6][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0,0}, {0.707f,0}, {0,0.707f} };
+// 6.1: FL FR FC LFE RC SL SR
+template <> const float Fold<7>::weights[7][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0,0}, {0.5f,0.5f}, {0.707f,0}, {0,0.707f} };
+// 7.1: FL FR FC LFE RL RR SL SR
+template <> const float Fold<8>::weights[8][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0,0}, {0.707f,0}, {0,0.707f}, {0.707f,0}, {0,0.707f} };
+
+namespace {
+
+const SampleFormat::Type INT8 = SampleFormat::INT8;
+const SampleFormat::Type INT16 = SampleFormat::INT16;
+const SampleFormat::Type FLOAT32 = SampleFormat::FLOAT32;
+const unsigned int TYPES = 3;
+const unsigned int CHANNELS = SampleFormat::MAX_CHANNELS + 1;
+
+// every instance, indexed by channel count and sample types
+class Table {
+public:
+    SampleKernels::ConvertFunc convert[TYPES][TYPES];
+    SampleKernels::DownmixFunc downmix[CHANNELS][TYPES][TYPES];
+    SampleKernels::DeinterleaveFunc deinterleave[CHANNELS][TYPES];
+    SampleKernels::GainFunc gain[TYPES];
+    SampleKernels::DecimateFunc decimate[TYPES][TYPES];
+
+    template <SampleFormat::Type F, SampleFormat::Type T>
+    void AddPair() {
+        convert[F][T] = &ConvertKernel<F, T>;
+        decimate[F][T] = &DecimateKernel<F, T>;
+    }
+
+    template <SampleFormat::Type F>
+    void AddFrom() {
+        AddPair<F, INT8>();
+        AddPair<F, INT16>();
+        AddPair<F, FLOAT32>();
+        gain[F] = &GainKernel<F>;
+    }
+
+    template <unsigned int C>
+    void AddChannels() {
+        downmix[C][INT8][INT8]       = &DownmixKernel<INT8, INT8, C>;
+        downmix[C][INT8][INT16]      = &DownmixKernel<INT8, INT16, C>;
+        downmix[C][INT8][FLOAT32]    = &DownmixKernel<INT8, FLOAT32, C>;
+        downmix[C][INT16][INT8]      = &DownmixKernel<INT16, INT8, C>;
+        downmix[C][INT16][INT16]     = &DownmixKernel<INT16, INT16, C>;
+        downmix[C][INT16][FLOAT32]   = &DownmixKernel<INT16, FLOAT32, C>;
+        downmix[C][FLOAT32][INT8]    = &DownmixKernel<FLOAT32, INT8, C>;
+        downmix[C][FLOAT32][INT16]   = &DownmixKernel<FLOAT32, INT16, C>;
+        downmix[C][FLOAT32][FLOAT32] = &DownmixKernel<FLOAT32, FLOAT32, C>;
+        deinterleave[C][INT8]    = &DeinterleaveKernel<unsigned char, C>;
+        deinterleave[C][INT16]   = &DeinterleaveKernel<short, C>;
+        deinterleave[C][FLOAT32] = &DeinterleaveKernel<float, C>;
+    }
+
+    Table() {
+        AddFrom<INT8>();
+        AddFrom<INT16>();
+        AddFrom<FLOAT32>();
+        for (unsigned int i = 0; i < TYPES; ++i) {
+            deinterleave[0][i] = NULL;
+            for (unsigned int j = 0; j < TYPES; ++j)
+                downmix[0][i][j] = NULL;
+        }
+        AddChannels<1>();
+        AddChannels<2>();
+        AddChannels<3>();
+        AddChannels<4>();
+        AddChannels<5>();
+        AddChannels<6>();
+        AddChannels<7>();
+        AddChannels<8>();
+    }
+};
+
+// built before main, so worker threads never race its construction
+const Table table;
+
+const Table& Kernels() {
+    return table;
+}
+
+} // anonymous namespace
+
+SampleKernels::ConvertFunc SampleKernels::Converter(SampleFormat::Type from,
+                                                    SampleFormat::Type to) {
+    return Kernels().convert[from][to];
+}
+
+SampleKernels::DownmixFunc SampleKernels::Downmixer(SampleFormat from,
+                                                    SampleFormat::Type to) {
+    if (from.channels > SampleFormat::MAX_CHANNELS)
+        return NULL;
+    return Kernels().downmix[from.channels][from.type][to];
+}
+
+SampleKernels::DeinterleaveFunc SampleKernels::Deinterleaver(SampleFormat format) {
+    if (format.channels > SampleFormat::MAX_CHANNELS)
+        return NULL;
+    return Kernels().deinterleave[format.channels][format.type];
+}
+
+SampleKernels::GainFunc SampleKernels::Gainer(SampleFormat::Type type) {
+    return Kernels().gain[type];
+}
+
+SampleKernels::DecimateFunc SampleKernels::Decimator(SampleFormat::Type from,
+                                                     SampleFormat::Type to) {
+    return Kernels().decimate[from][to];
+}
+
+} // NS Sound
+} // NS OpenEngine
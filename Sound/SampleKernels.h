@@ -0,0 +1,154 @@
+// Specialized loops over interleaved sample data.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_SAMPLE_KERNELS_H_
+#define _OE_SAMPLE_KERNELS_H_
+
+#include <Sound/SampleFormat.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+/**
+ * Storage type and float mapping of each sample type. Reading maps
+ * to [-1, 1), writing clamps and maps back.
+ */
+template <SampleFormat::Type T> struct Sample;
+
+template <> struct Sample<SampleFormat::INT8> {
+    typedef unsigned char Type;
+    static inline float Read(Type v) { return ((int)v - 128) * (1.0f / 128.0f); }
+    static inline Type Write(float v) {
+        v = v * 128.0f + 128.0f;
+        return (Type)(v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v));
+    }
+};
+
+template <> struct Sample<SampleFormat::INT16> {
+    typedef short Type;
+    static inline float Read(Type v) { return v * (1.0f / 32768.0f); }
+    static inline Type Write(float v) {
+        v = v * 32768.0f;
+        return (Type)(v < -32768.0f ? -32768.0f : (v > 32767.0f ? 32767.0f : v));
+    }
+};
+
+template <> struct Sample<SampleFormat::FLOAT32> {
+    typedef float Type;
+    static inline float Read(Type v) { return v; }
+    static inline Type Write(float v) { return v; }
+};
+
+/**
+ * Left and right weight of each channel when folding a layout down
+ * to stereo. Channels are in OpenAL order, the center goes to both
+ * sides, rear and side channels to their side and the LFE is
+ * dropped.
+ */
+template <unsigned int C> struct Fold {
+    static const float weights[C][2];
+};
+
+/**
+ * Sample kernels.
+ * Conversion, downmix, deinterleave, gain and decimation loops,
+ * instantiated for each sample type and channel count so the inner
+ * loops have no branches on the format and a fixed trip count per
+ * frame. Callers pick the instance for a format once through the
+ * lookup functions and run it over whole buffers. A lookup returns
+ * NULL when there is no kernel for the combination.
+ *
+ * @class SampleKernels SampleKernels.h Sound/SampleKernels.h
+ */
+class SampleKernels {
+public:
+    //! Convert samples of one type to another, any channel count.
+    typedef void (*ConvertFunc)(const char* in, char* out,
+                                unsigned int samples);
+    //! Fold frames of some channel count to stereo frames.
+    typedef void (*DownmixFunc)(const char* in, char* out,
+                                unsigned int frames);
+    //! Split frames into one buffer per channel.
+    typedef void (*DeinterleaveFunc)(const char* in, char** out,
+                                     unsigned int frames);
+    //! Scale samples in place.
+    typedef void (*GainFunc)(char* data, unsigned int samples, float gain);
+    //! Average each run of factor mono samples into one.
+    typedef void (*DecimateFunc)(const char* in, char* out,
+                                 unsigned int samples, unsigned int factor);
+
+    static ConvertFunc Converter(SampleFormat::Type from, SampleFormat::Type to);
+    static DownmixFunc Downmixer(SampleFormat from, SampleFormat::Type to);
+    static DeinterleaveFunc Deinterleaver(SampleFormat format);
+    static GainFunc Gainer(SampleFormat::Type type);
+    static DecimateFunc Decimator(SampleFormat::Type from, SampleFormat::Type to);
+};
+
+template <SampleFormat::Type From, SampleFormat::Type To>
+void ConvertKernel(const char* in, char* out, unsigned int samples) {
+    const typename Sample<From>::Type* src = (const typename Sample<From>::Type*)in;
+    typename Sample<To>::Type* dst = (typename Sample<To>::Type*)out;
+    for (unsigned int i = 0; i < samples; ++i)
+        dst[i] = Sample<To>::Write(Sample<From>::Read(src[i]));
+}
+
+template <SampleFormat::Type From, SampleFormat::Type To, unsigned int C>
+void DownmixKernel(const char* in, char* out, unsigned int frames) {
+    const typename Sample<From>::Type* src = (const typename Sample<From>::Type*)in;
+    typename Sample<To>::Type* dst = (typename Sample<To>::Type*)out;
+    for (unsigned int f = 0; f < frames; ++f) {
+        float left = 0.0f, right = 0.0f;
+        for (unsigned int c = 0; c < C; ++c) {
+            float v = Sample<From>::Read(src[f * C + c]);
+            left += v * Fold<C>::weights[c][0];
+            right += v * Fold<C>::weights[c][1];
+        }
+        dst[2 * f] = Sample<To>::Write(left);
+        dst[2 * f + 1] = Sample<To>::Write(right);
+    }
+}
+
+template <class T, unsigned int C>
+void DeinterleaveKernel(const char* in, char** out, unsigned int frames) {
+    const T* src = (const T*)in;
+    for (unsigned int c = 0; c < C; ++c) {
+        T* dst = (T*)out[c];
+        for (unsigned int f = 0; f < frames; ++f)
+            dst[f] = src[f * C + c];
+    }
+}
+
+template <SampleFormat::Type T>
+void GainKernel(char* data, unsigned int samples, float gain) {
+    typename Sample<T>::Type* d = (typename Sample<T>::Type*)data;
+    for (unsigned int i = 0; i < samples; ++i)
+        d[i] = Sample<T>::Write(Sample<T>::Read(d[i]) * gain);
+}
+
+// averaging doubles as the low pass filter needed before dropping
+// the rate
+template <SampleFormat::Type From, SampleFormat::Type To>
+void DecimateKernel(const char* in, char* out, unsigned int samples,
+                    unsigned int factor) {
+    const typename Sample<From>::Type* src = (const typename Sample<From>::Type*)in;
+    typename Sample<To>::Type* dst = (typename Sample<To>::Type*)out;
+    unsigned int count = samples / factor;
+    float scale = 1.0f / factor;
+    for (unsigned int i = 0; i < count; ++i) {
+        float sum = 0.0f;
+        for (unsigned int j = 0; j < factor; ++j)
+            sum += Sample<From>::Read(src[i * factor + j]);
+        dst[i] = Sample<To>::Write(sum * scale);
+    }
+}
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_SAMPLE_KERNELS_H_
@@ -0,0 +1,51 @@
+// Counting semaphore for waking worker threads.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/Semaphore.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+Semaphore::Semaphore(unsigned int limit)
+    : count(0), limit(limit ? limit : 1) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&condition, NULL);
+}
+
+Semaphore::~Semaphore() {
+    pthread_cond_destroy(&condition);
+    pthread_mutex_destroy(&mutex);
+}
+
+void Semaphore::SetLimit(unsigned int limit) {
+    pthread_mutex_lock(&mutex);
+    this->limit = limit ? limit : 1;
+    if (count > this->limit) count = this->limit;
+    pthread_mutex_unlock(&mutex);
+}
+
+void Semaphore::Post() {
+    pthread_mutex_lock(&mutex);
+    if (count < limit) {
+        count++;
+        pthread_cond_signal(&condition);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void Semaphore::Wait() {
+    pthread_mutex_lock(&mutex);
+    while (count == 0)
+        pthread_cond_wait(&condition, &mutex);
+    count--;
+    pthread_mutex_unlock(&mutex);
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,50 @@
+// Counting semaphore for waking worker threads.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_SEMAPHORE_H_
+#define _OE_SEMAPHORE_H_
+
+#include <pthread.h>
+
+namespace OpenEngine {
+namespace Sound {
+
+/**
+ * Semaphore.
+ * Lets a worker sleep until there is work instead of polling. Each
+ * Post lets one Wait through, and posts made while nobody waits are
+ * kept, so a wake-up is never lost. The count stops at a limit, as
+ * posts beyond the number of waiters only cause empty wake-ups.
+ * Core::Mutex does not expose its handle to wait on, so this holds
+ * a mutex and condition of its own.
+ *
+ * @class Semaphore Semaphore.h Sound/Semaphore.h
+ */
+class Semaphore {
+private:
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    unsigned int count;
+    unsigned int limit;
+
+public:
+    Semaphore(unsigned int limit = 1);
+    ~Semaphore();
+
+    void SetLimit(unsigned int limit);
+    //! Let one waiter through, now or on its next Wait.
+    void Post();
+    //! Block until a post is available and take it.
+    void Wait();
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_SEMAPHORE_H_
@@ -0,0 +1,317 @@
+// Packed, memory mapped collection of sound clips.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/SoundBank.h>
+#include <Sound/AdpcmEncoder.h>
+#include <Sound/CompressedClip.h>
+
+#include <Core/Exceptions.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Core::Exception;
+using namespace OpenEngine::Resources;
+
+const unsigned int SoundBank::VERSION;
+const unsigned int SoundBank::ALIGNMENT;
+const unsigned int SoundBank::NAME_LENGTH;
+
+static const char MAGIC[8] = { 'O','E','S','B','A','N','K','1' };
+
+/**
+ * Static resource over a PCM clip in a mapped bank. Loading and
+ * unloading do nothing, the pages come and go with the mapping.
+ */
+class BankResource : public ISoundResource, public IChannelLayout {
+private:
+    SoundBankPtr bank;
+    const SoundBank::Entry* entry;
+    char* data;
+public:
+    BankResource(SoundBankPtr bank, const SoundBank::Entry* entry)
+        : bank(bank), entry(entry)
+        // the mapping is private, so a write only copies its page
+        , data(const_cast<char*>(bank->GetData(entry))) {}
+    char* GetBuffer() { return data; }
+    unsigned int GetBufferSize() { return entry->size; }
+    unsigned int GetFrequency() { return entry->frequency; }
+    unsigned int GetBitsPerSample() {
+        return bank->GetFormat(entry).BytesPerSample() * 8;
+    }
+    SoundFormat GetFormat() { return entry->channels == 1 ? MONO : STEREO; }
+    unsigned int GetChannels() { return entry->channels; }
+    void Load() {}
+    void Unload() {}
+};
+
+/**
+ * Stream over a PCM clip in a mapped bank.
+ */
+class BankStream : public IStreamingSoundResource {
+private:
+    SoundBankPtr bank;
+    const SoundBank::Entry* entry;
+    unsigned int position;
+public:
+    BankStream(SoundBankPtr bank, const SoundBank::Entry* entry)
+        : bank(bank), entry(entry), position(0) {}
+    unsigned int GetBuffer(unsigned int size, char* buf) {
+        unsigned int frame = bank->GetFormat(entry).FrameSize();
+        unsigned int count = std::min(size, entry->size - position);
+        count -= count % frame;
+        memcpy(buf, bank->GetData(entry) + position, count);
+        position += count;
+        return count;
+    }
+    unsigned int GetFrequency() { return entry->frequency; }
+    unsigned int GetBitsPerSample() {
+        return bank->GetFormat(entry).BytesPerSample() * 8;
+    }
+    SoundFormat GetFormat() { return entry->channels == 1 ? MONO : STEREO; }
+    unsigned int GetNumberOfSamples() { return entry->frames; }
+    void Load() { position = 0; }
+    void Unload() { position = 0; }
+};
+
+SoundBank::SoundBank(string path)
+    : path(path), map(NULL), mapSize(0)
+#ifdef _WIN32
+    , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+    , header(NULL), index(NULL) {}
+
+SoundBankPtr SoundBank::Open(string path) {
+    SoundBankPtr bank(new SoundBank(path));
+    bank->self = bank;
+
+#ifdef _WIN32
+    bank->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (bank->file == INVALID_HANDLE_VALUE)
+        throw Exception("could not open sound bank " + path);
+    LARGE_INTEGER size;
+    GetFileSizeEx(bank->file, &size);
+    bank->mapSize = size.QuadPart;
+    bank->mapping = CreateFileMappingA(bank->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (bank->mapping)
+        bank->map = (char*)MapViewOfFile(bank->mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!bank->map)
+        throw Exception("could not map sound bank " + path);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw Exception("could not open sound bank " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+        close(fd);
+        throw Exception("sound bank " + path + " is truncated");
+    }
+    bank->mapSize = st.st_size;
+    void* map = mmap(NULL, bank->mapSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file open
+    close(fd);
+    if (map == MAP_FAILED)
+        throw Exception("could not map sound bank " + path);
+    bank->map = (char*)map;
+#endif
+
+    const Header* header = (const Header*)bank->map;
+    if (bank->mapSize < sizeof(Header) ||
+        memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+        throw Exception(path + " is not a sound bank");
+    if (header->version != VERSION)
+        throw Exception("unsupported version of sound bank " + path);
+    if (header->indexOffset > bank->mapSize ||
+        (bank->mapSize - header->indexOffset) / sizeof(Entry) < header->count)
+        throw Exception("sound bank " + path + " has a truncated index");
+    bank->header = header;
+    bank->index = (const Entry*)(bank->map + header->indexOffset);
+    // entries are checked once here, so lookups can trust them
+    for (unsigned int i = 0; i < header->count; ++i) {
+        const Entry& e = bank->index[i];
+        if (e.offset > bank->mapSize || e.size > bank->mapSize - e.offset ||
+            e.name[NAME_LENGTH - 1] != 0 || e.encoding > IMA4 ||
+            e.channels == 0 || e.channels > SampleFormat::MAX_CHANNELS ||
+            (e.encoding == IMA4 && e.channels > 2))
+            throw Exception("sound bank " + path + " has a bad entry");
+    }
+    return bank;
+}
+
+SoundBank::~SoundBank() {
+    Close();
+}
+
+void SoundBank::Close() {
+#ifdef _WIN32
+    if (map) UnmapViewOfFile(map);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (map) munmap(map, mapSize);
+#endif
+    map = NULL;
+}
+
+string SoundBank::GetPath() {
+    return path;
+}
+
+unsigned int SoundBank::GetCount() {
+    return header->count;
+}
+
+const SoundBank::Entry* SoundBank::GetEntry(unsigned int i) {
+    if (i >= header->count)
+        return NULL;
+    return &index[i];
+}
+
+const SoundBank::Entry* SoundBank::Find(string name) {
+    unsigned int lo = 0, hi = header->count;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        int cmp = strcmp(index[mid].name, name.c_str());
+        if (cmp == 0)
+            return &index[mid];
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+const char* SoundBank::GetData(const Entry* entry) {
+    return map + entry->offset;
+}
+
+SampleFormat SoundBank::GetFormat(const Entry* entry) {
+    switch (entry->encoding) {
+    case PCM8:        return SampleFormat(entry->channels, SampleFormat::INT8);
+    case PCM_FLOAT32: return SampleFormat(entry->channels, SampleFormat::FLOAT32);
+    default:          return SampleFormat(entry->channels, SampleFormat::INT16);
+    }
+}
+
+ISoundResourcePtr SoundBank::GetResource(const Entry* entry) {
+    if (entry->encoding == IMA4)
+        throw Exception(string("sound bank clip ") + entry->name +
+                        " is compressed and can only be streamed");
+    return ISoundResourcePtr(new BankResource(self.lock(), entry));
+}
+
+IStreamingSoundResourcePtr SoundBank::GetStream(const Entry* entry) {
+    if (entry->encoding == IMA4)
+        return IStreamingSoundResourcePtr
+            (new CompressedClip(self.lock(), GetData(entry), entry->size,
+                                entry->frequency, entry->channels, entry->frames));
+    return IStreamingSoundResourcePtr(new BankStream(self.lock(), entry));
+}
+
+static bool ByName(const SoundBank::Entry& a, const SoundBank::Entry& b) {
+    return strcmp(a.name, b.name) < 0;
+}
+
+void SoundBankWriter::Add(string name, SampleFormat format,
+                          unsigned int frequency, const char* data,
+                          unsigned int size, bool adpcm) {
+    if (name.empty() || name.size() >= SoundBank::NAME_LENGTH)
+        throw Exception("sound bank clip names must be 1 to 47 characters");
+    for (unsigned int i = 0; i < clips.size(); ++i)
+        if (name == clips[i].entry.name)
+            throw Exception("sound bank already has a clip named " + name);
+    if (format.channels == 0 || format.channels > SampleFormat::MAX_CHANNELS)
+        throw Exception("unsupported number of channels");
+
+    Clip clip;
+    memset(&clip.entry, 0, sizeof(clip.entry));
+    strcpy(clip.entry.name, name.c_str());
+    clip.entry.frequency = frequency;
+    clip.entry.frames = size / format.FrameSize();
+    clip.entry.channels = format.channels;
+    if (adpcm && format.type == SampleFormat::INT16 && format.channels <= 2) {
+        AdpcmEncoder::Encode((const short*)data, clip.entry.frames,
+                             format.channels, clip.data);
+        clip.entry.encoding = SoundBank::IMA4;
+    } else {
+        clip.data.assign(data, data + clip.entry.frames * format.FrameSize());
+        switch (format.type) {
+        case SampleFormat::INT8:  clip.entry.encoding = SoundBank::PCM8; break;
+        case SampleFormat::INT16: clip.entry.encoding = SoundBank::PCM16; break;
+        default:                  clip.entry.encoding = SoundBank::PCM_FLOAT32; break;
+        }
+    }
+    clip.entry.size = clip.data.size();
+    clips.push_back(clip);
+}
+
+unsigned int SoundBankWriter::GetCount() {
+    return clips.size();
+}
+
+void SoundBankWriter::Write(string path) {
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw Exception("could not write sound bank " + path);
+
+    // payloads start on page boundaries after the header
+    static const char zeros[SoundBank::ALIGNMENT] = { 0 };
+    vector<SoundBank::Entry> index;
+    uint64_t offset = SoundBank::ALIGNMENT;
+    for (unsigned int i = 0; i < clips.size(); ++i) {
+        SoundBank::Entry entry = clips[i].entry;
+        entry.offset = offset;
+        index.push_back(entry);
+        offset += entry.size;
+        offset = (offset + SoundBank::ALIGNMENT - 1) / SoundBank::ALIGNMENT
+            * SoundBank::ALIGNMENT;
+    }
+
+    SoundBank::Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = SoundBank::VERSION;
+    header.count = clips.size();
+    header.indexOffset = offset;
+    file.write((const char*)&header, sizeof(header));
+    file.write(zeros, SoundBank::ALIGNMENT - sizeof(header));
+    for (unsigned int i = 0; i < clips.size(); ++i) {
+        unsigned int size = clips[i].data.size();
+        if (size)
+            file.write(&clips[i].data[0], size);
+        unsigned int pad = (SoundBank::ALIGNMENT - size % SoundBank::ALIGNMENT)
+            % SoundBank::ALIGNMENT;
+        file.write(zeros, pad);
+    }
+    std::sort(index.begin(), index.end(), ByName);
+    if (!index.empty())
+        file.write((const char*)&index[0], index.size() * sizeof(SoundBank::Entry));
+    if (!file)
+        throw Exception("could not write sound bank " + path);
+}
+
+} // NS Sound
+} // NS OpenEngine
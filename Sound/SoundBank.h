@@ -0,0 +1,138 @@
+// Packed, memory mapped collection of sound clips.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_SOUND_BANK_H_
+#define _OE_SOUND_BANK_H_
+
+#include <Sound/SampleFormat.h>
+#include <Resources/ISoundResource.h>
+#include <Resources/IStreamingSoundResource.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+using std::string;
+using std::vector;
+using OpenEngine::Resources::ISoundResourcePtr;
+using OpenEngine::Resources::IStreamingSoundResourcePtr;
+
+class SoundBank;
+typedef std::tr1::shared_ptr<SoundBank> SoundBankPtr;
+
+/**
+ * Sound bank.
+ * A file of clips laid out to be used in place: a header, the clip
+ * payloads each starting on a page boundary, and an index of fixed
+ * size entries sorted by name. Opening a bank maps the file and
+ * checks the header and index, nothing else is read. Resources from
+ * a bank point into the mapping, so a clip's pages are only read
+ * from disk when it is played, and the bank stays mapped while any
+ * of its resources live.
+ *
+ * PCM clips become static resources, IMA ADPCM clips compressed
+ * streams, see CompressedClip. Banks are written with
+ * SoundBankWriter in the byte order of the host.
+ *
+ * @class SoundBank SoundBank.h Sound/SoundBank.h
+ */
+class SoundBank {
+public:
+    enum Encoding { PCM8, PCM16, PCM_FLOAT32, IMA4 };
+
+    static const unsigned int VERSION = 1;
+    static const unsigned int ALIGNMENT = 4096;
+    static const unsigned int NAME_LENGTH = 48;
+
+    class Header {
+    public:
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t indexOffset;
+    };
+
+    class Entry {
+    public:
+        char name[NAME_LENGTH]; // zero terminated
+        uint64_t offset;
+        uint32_t size;          // payload bytes
+        uint32_t frequency;
+        uint32_t frames;
+        uint16_t channels;
+        uint8_t encoding;
+        uint8_t reserved;
+    };
+
+private:
+    string path;
+    char* map;
+    uint64_t mapSize;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#endif
+    const Header* header;
+    const Entry* index;
+    std::tr1::weak_ptr<SoundBank> self;
+
+    SoundBank(string path);
+    void Close();
+
+public:
+    //! Map a bank, throws if it is missing or malformed.
+    static SoundBankPtr Open(string path);
+    ~SoundBank();
+
+    string GetPath();
+    unsigned int GetCount();
+    const Entry* GetEntry(unsigned int i);
+    //! Binary search of the index, NULL if there is no such clip.
+    const Entry* Find(string name);
+    const char* GetData(const Entry* entry);
+    SampleFormat GetFormat(const Entry* entry);
+
+    //! A static resource over a PCM clip.
+    ISoundResourcePtr GetResource(const Entry* entry);
+    //! A stream over any clip.
+    IStreamingSoundResourcePtr GetStream(const Entry* entry);
+};
+
+/**
+ * Sound bank writer.
+ * Collects clips and writes them as a bank, see SoundBank. Clips
+ * can be encoded to IMA ADPCM on the way in.
+ *
+ * @class SoundBankWriter SoundBank.h Sound/SoundBank.h
+ */
+class SoundBankWriter {
+private:
+    class Clip {
+    public:
+        SoundBank::Entry entry;
+        vector<char> data;
+    };
+    vector<Clip> clips;
+
+public:
+    //! Add a clip of interleaved samples, throws on bad names and formats.
+    void Add(string name, SampleFormat format, unsigned int frequency,
+             const char* data, unsigned int size, bool adpcm = false);
+    unsigned int GetCount();
+    //! Write the bank, throws if the file cannot be written.
+    void Write(string path);
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_SOUND_BANK_H_
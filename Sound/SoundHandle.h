@@ -0,0 +1,48 @@
+// Handle naming a sound in a sound system.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS) 
+// 
+// This program is free software; It is covered by the GNU General 
+// Public License version 2 or any later version. 
+// See the GNU General Public License for more details (see LICENSE). 
+//--------------------------------------------------------------------
+
+#ifndef _OE_SOUND_HANDLE_H_
+#define _OE_SOUND_HANDLE_H_
+
+namespace OpenEngine {
+namespace Sound {
+
+/**
+ * Sound handle.
+ * Names a slot in the sound system together with the generation the
+ * slot had when the sound was created. Once the sound is destroyed
+ * the slot generation changes and the handle becomes stale, so it
+ * can be detected instead of pointing at a reused slot.
+ *
+ * @class SoundHandle SoundHandle.h Sound/SoundHandle.h
+ */
+class SoundHandle {
+public:
+    unsigned int index;
+    unsigned int generation;
+
+    SoundHandle(): index(0), generation(0) {}
+    SoundHandle(unsigned int index, unsigned int generation)
+        : index(index), generation(generation) {}
+
+    //! The null handle never names a sound.
+    bool IsNull() const { return generation == 0; }
+
+    bool operator==(const SoundHandle& h) const {
+        return index == h.index && generation == h.generation;
+    }
+    bool operator!=(const SoundHandle& h) const {
+        return !(*this == h);
+    }
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_SOUND_HANDLE_H_
@@ -0,0 +1,167 @@
+// Uniform grid over sound emitter positions.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/SpatialGrid.h>
+
+#include <algorithm>
+#include <utility>
+#include <cmath>
+
+namespace OpenEngine {
+namespace Sound {
+
+using std::pair;
+using std::make_pair;
+
+SpatialGrid::SpatialGrid(float cellSize, unsigned int buckets)
+    : cellSize(cellSize), count(0) {
+    // round the table up to a power of two so hashing is a mask
+    unsigned int size = 1;
+    while (size < buckets) size <<= 1;
+    table.resize(size, -1);
+    mask = size - 1;
+}
+
+SpatialGrid::Cell SpatialGrid::CellOf(Vector<3,float> p) const {
+    return Cell((int)floor(p[0] / cellSize),
+                (int)floor(p[1] / cellSize),
+                (int)floor(p[2] / cellSize));
+}
+
+unsigned int SpatialGrid::Bucket(Cell c) const {
+    return (((unsigned int)c.x * 73856093u) ^
+            ((unsigned int)c.y * 19349663u) ^
+            ((unsigned int)c.z * 83492791u)) & mask;
+}
+
+void SpatialGrid::Link(unsigned int id) {
+    int& head = table[Bucket(cell[id])];
+    prev[id] = -1;
+    next[id] = head;
+    if (head != -1) prev[head] = id;
+    head = id;
+    present[id] = true;
+}
+
+void SpatialGrid::Unlink(unsigned int id) {
+    if (prev[id] != -1) next[prev[id]] = next[id];
+    else table[Bucket(cell[id])] = next[id];
+    if (next[id] != -1) prev[next[id]] = prev[id];
+    present[id] = false;
+}
+
+void SpatialGrid::Reserve(unsigned int count) {
+    if (count <= present.size()) return;
+    position.resize(count);
+    cell.resize(count);
+    next.resize(count, -1);
+    prev.resize(count, -1);
+    present.resize(count, false);
+}
+
+void SpatialGrid::Insert(unsigned int id, Vector<3,float> p) {
+    Reserve(id + 1);
+    if (present[id]) {
+        Move(id, p);
+        return;
+    }
+    position[id] = p;
+    cell[id] = CellOf(p);
+    Link(id);
+    count++;
+}
+
+void SpatialGrid::Move(unsigned int id, Vector<3,float> p) {
+    if (!Contains(id)) return;
+    position[id] = p;
+    Cell c = CellOf(p);
+    if (c == cell[id]) return;
+    Unlink(id);
+    cell[id] = c;
+    Link(id);
+}
+
+void SpatialGrid::Remove(unsigned int id) {
+    if (!Contains(id)) return;
+    Unlink(id);
+    count--;
+}
+
+bool SpatialGrid::Contains(unsigned int id) const {
+    return id < present.size() && present[id];
+}
+
+unsigned int SpatialGrid::Size() const {
+    return count;
+}
+
+void SpatialGrid::SetCellSize(float size) {
+    cellSize = size;
+    for (unsigned int b = 0; b < table.size(); ++b)
+        table[b] = -1;
+    for (unsigned int id = 0; id < present.size(); ++id) {
+        if (!present[id]) continue;
+        cell[id] = CellOf(position[id]);
+        Link(id);
+    }
+}
+
+float SpatialGrid::GetCellSize() const {
+    return cellSize;
+}
+
+void SpatialGrid::QueryRadius(Vector<3,float> center, float radius,
+                              vector<unsigned int>& out) const {
+    float r2 = radius * radius;
+
+    // a radius covering more cells than there are buckets is
+    // cheaper to answer by scanning the table
+    float span = 2.0 * radius / cellSize + 1.0;
+    if (span * span * span >= table.size()) {
+        for (unsigned int b = 0; b < table.size(); ++b)
+            for (int id = table[b]; id != -1; id = next[id])
+                if ((position[id] - center).GetLengthSquared() <= r2)
+                    out.push_back(id);
+        return;
+    }
+
+    Vector<3,float> extent(radius, radius, radius);
+    Cell lo = CellOf(center - extent);
+    Cell hi = CellOf(center + extent);
+    for (int x = lo.x; x <= hi.x; ++x)
+        for (int y = lo.y; y <= hi.y; ++y)
+            for (int z = lo.z; z <= hi.z; ++z) {
+                Cell c(x, y, z);
+                for (int id = table[Bucket(c)]; id != -1; id = next[id]) {
+                    // buckets are shared by cells hashing alike
+                    if (!(cell[id] == c)) continue;
+                    if ((position[id] - center).GetLengthSquared() <= r2)
+                        out.push_back(id);
+                }
+            }
+}
+
+void SpatialGrid::QueryNearest(Vector<3,float> center, unsigned int count,
+                               float radius, vector<unsigned int>& out) const {
+    vector<unsigned int> found;
+    QueryRadius(center, radius, found);
+    vector<pair<float, unsigned int> > sorted;
+    sorted.reserve(found.size());
+    for (unsigned int i = 0; i < found.size(); ++i) {
+        unsigned int id = found[i];
+        sorted.push_back(make_pair((position[id] - center).GetLengthSquared(), id));
+    }
+    unsigned int n = std::min(count, (unsigned int)sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + n, sorted.end());
+    for (unsigned int i = 0; i < n; ++i)
+        out.push_back(sorted[i].second);
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,86 @@
+// Uniform grid over sound emitter positions.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_SPATIAL_GRID_H_
+#define _OE_SPATIAL_GRID_H_
+
+#include <Math/Vector.h>
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Math::Vector;
+using std::vector;
+
+/**
+ * Spatial grid.
+ * Buckets points into cubic cells hashed into a fixed size table, so
+ * moving a point and finding the points around a position costs time
+ * proportional to the cells covered, not to the number of points.
+ * Points are named by small dense ids, typically voice indices.
+ * Buckets are lists threaded through the ids, so once an id has
+ * been inserted moving it never allocates.
+ *
+ * @class SpatialGrid SpatialGrid.h Sound/SpatialGrid.h
+ */
+class SpatialGrid {
+private:
+    class Cell {
+    public:
+        int x, y, z;
+        Cell(): x(0), y(0), z(0) {}
+        Cell(int x, int y, int z): x(x), y(y), z(z) {}
+        bool operator==(const Cell& c) const {
+            return x == c.x && y == c.y && z == c.z;
+        }
+    };
+
+    float cellSize;
+    unsigned int mask;
+    vector<int> table; // first id of each bucket, -1 when empty
+    unsigned int count;
+
+    // per id
+    vector<Vector<3,float> > position;
+    vector<Cell> cell;
+    vector<int> next, prev; // neighbours in the bucket, -1 at the ends
+    vector<bool> present;
+
+    Cell CellOf(Vector<3,float> p) const;
+    unsigned int Bucket(Cell c) const;
+    void Link(unsigned int id);
+    void Unlink(unsigned int id);
+
+public:
+    SpatialGrid(float cellSize = 250.0, unsigned int buckets = 4096);
+
+    void Insert(unsigned int id, Vector<3,float> p);
+    void Move(unsigned int id, Vector<3,float> p);
+    void Remove(unsigned int id);
+    //! Make room for ids below count.
+    void Reserve(unsigned int count);
+    bool Contains(unsigned int id) const;
+    unsigned int Size() const;
+
+    void SetCellSize(float size);
+    float GetCellSize() const;
+
+    //! Append the ids within radius of center to out.
+    void QueryRadius(Vector<3,float> center, float radius,
+                     vector<unsigned int>& out) const;
+    //! Append the count nearest ids within radius, nearest first.
+    void QueryNearest(Vector<3,float> center, unsigned int count,
+                      float radius, vector<unsigned int>& out) const;
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_SPATIAL_GRID_H_
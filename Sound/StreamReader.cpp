@@ -0,0 +1,334 @@
+// Read-ahead of playing streaming sound resources.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include <Sound/StreamReader.h>
+#include <Sound/SampleFormat.h>
+
+#include <cstring>
+
+namespace OpenEngine {
+namespace Sound {
+
+const unsigned int StreamReader::CHUNK;
+
+StreamReader::StreamReader()
+    : running(false), underruns(0) {}
+
+StreamReader::~StreamReader() {
+    Stop();
+    for (unsigned int i = 0; i < streams.size(); ++i)
+        delete streams[i];
+}
+
+void StreamReader::Start(unsigned int threads) {
+    if (running) return;
+    running = true;
+    if (threads == 0) threads = 1;
+    wake.SetLimit(threads);
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.push_back(new Worker(this));
+        workers.back()->Start();
+    }
+}
+
+void StreamReader::Stop() {
+    if (!running) return;
+    running = false;
+    for (unsigned int i = 0; i < workers.size(); ++i)
+        wake.Post();
+    for (unsigned int i = 0; i < workers.size(); ++i) {
+        workers[i]->Wait();
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+bool StreamReader::IsRunning() {
+    return running;
+}
+
+ReadAheadStream* StreamReader::Attach(IStreamingSoundResourcePtr resource,
+                                      unsigned int capacity,
+                                      unsigned int position) {
+    unsigned int frameSize = SampleFormat::Of(resource).FrameSize();
+    if (frameSize == 0) frameSize = 1;
+    unsigned int byteRate = frameSize * resource->GetFrequency();
+    if (byteRate == 0) byteRate = 1;
+    // whole chunks, so the reader never splits a read
+    if (capacity < 2 * CHUNK) capacity = 2 * CHUNK;
+    capacity -= capacity % CHUNK;
+    ReadAheadStream* stream = 
+        new ReadAheadStream(resource, capacity, frameSize, byteRate, position);
+    lock.Lock();
+    streams.push_back(stream);
+    lock.Unlock();
+    wake.Post();
+    return stream;
+}
+
+void StreamReader::Detach(ReadAheadStream* stream) {
+    lock.Lock();
+    for (unsigned int i = 0; i < streams.size(); ++i) {
+        if (streams[i] == stream) {
+            streams[i] = streams.back();
+            streams.pop_back();
+            break;
+        }
+    }
+    // wait out a read in progress
+    while (stream->reading) {
+        lock.Unlock();
+        Thread::Sleep(100);
+        lock.Lock();
+    }
+    lock.Unlock();
+    delete stream;
+}
+
+// called with the lock held
+void StreamReader::Append(ReadAheadStream* stream, const char* data,
+                          unsigned int size) {
+    unsigned int capacity = stream->ring.size();
+    unsigned int tail = (stream->head + stream->fill) % capacity;
+    unsigned int first = size < capacity - tail ? size : capacity - tail;
+    memcpy(&stream->ring[tail], data, first);
+    memcpy(&stream->ring[0], data + first, size - first);
+    stream->fill += size;
+}
+
+// called with the lock held
+void StreamReader::Drop(ReadAheadStream* stream, unsigned int size) {
+    stream->head = (stream->head + size) % stream->ring.size();
+    stream->fill -= size;
+}
+
+/**
+ * Read from the resource of a stream, starting it over first if
+ * that is due, and at most up to the loop end. Sets passEnded when
+ * the read reached the end of the pass. Called holding the io lock
+ * of the stream.
+ */
+unsigned int StreamReader::ReadResource(ReadAheadStream* stream, char* buf,
+                                        unsigned int size, bool& passEnded) {
+    lock.Lock();
+    bool restart = stream->restart;
+    unsigned int start = stream->restartAt;
+    unsigned int end = stream->looping ? stream->loopEnd : 0;
+    stream->restart = false;
+    lock.Unlock();
+
+    IStreamingSoundResourcePtr resource = stream->resource;
+    unsigned int frameSize = stream->frameSize;
+    if (restart) {
+        resource->Unload();
+        resource->Load();
+        stream->position = 0;
+        // buf serves as scratch for the frames skipped
+        while (stream->position < start) {
+            unsigned int skip = (start - stream->position) * frameSize;
+            if (skip > size) skip = size;
+            unsigned int read = resource->GetBuffer(skip, buf) / frameSize;
+            if (read == 0) 
+                break;
+            stream->position += read;
+        }
+        stream->passFrames = 0;
+    }
+    if (end && stream->position + size / frameSize > end)
+        size = (end > stream->position ? end - stream->position : 0) * frameSize;
+    unsigned int read = size ? resource->GetBuffer(size, buf) : 0;
+    stream->position += read / frameSize;
+    stream->passFrames += read / frameSize;
+    passEnded = read < size || (end && stream->position >= end);
+    return read;
+}
+
+/**
+ * Mark the end of a pass at the end of the ring and have the next
+ * one read from the loop start, or end the stream. A pass with no
+ * frames would only repeat, so it ends the stream as well. Called
+ * holding both locks.
+ */
+void StreamReader::EndPass(ReadAheadStream* stream) {
+    if (!stream->looping || stream->passFrames == 0) {
+        stream->ended = true;
+        return;
+    }
+    unsigned int marked = 0;
+    for (unsigned int i = 0; i < stream->passes.size(); ++i)
+        marked += stream->passes[i].bytes;
+    stream->passes.push_back(ReadAheadStream::Pass(stream->fill - marked,
+                                                   stream->loopStart));
+    stream->restart = true;
+    stream->restartAt = stream->loopStart;
+}
+
+unsigned int StreamReader::Read(ReadAheadStream* stream, char* buf,
+                                unsigned int size) {
+    size -= size % stream->frameSize;
+    bool direct = false;
+    lock.Lock();
+    if (stream->passes.empty() && stream->fill < size && !stream->ended) {
+        // take the resource from the reader, then drain what it has
+        stream->waiting = true;
+        lock.Unlock();
+        stream->io.Lock();
+        lock.Lock();
+        stream->waiting = false;
+        direct = true;
+    }
+    // reads stop at the end of a pass
+    unsigned int limit = size;
+    if (!stream->passes.empty() && stream->passes.front().bytes < limit)
+        limit = stream->passes.front().bytes;
+    unsigned int count = stream->fill < limit ? stream->fill : limit;
+    unsigned int capacity = stream->ring.size();
+    unsigned int first = count < capacity - stream->head ? count : capacity - stream->head;
+    memcpy(buf, &stream->ring[stream->head], first);
+    memcpy(buf + first, &stream->ring[0], count - first);
+    Drop(stream, count);
+    bool marked = !stream->passes.empty();
+    if (marked)
+        stream->passes.front().bytes -= count;
+    bool ended = stream->ended;
+    lock.Unlock();
+
+    if (direct) {
+        if (count < size && !ended && !marked) {
+            underruns++;
+            bool passEnded;
+            unsigned int read = 
+                ReadResource(stream, buf + count, size - count, passEnded);
+            if (passEnded) {
+                lock.Lock();
+                EndPass(stream);
+                lock.Unlock();
+            }
+            count += read;
+        }
+        stream->io.Unlock();
+    }
+    // the ring has room again
+    if (count && !ended)
+        wake.Post();
+    return count;
+}
+
+void StreamReader::SetQueued(ReadAheadStream* stream,
+                             unsigned int microseconds) {
+    lock.Lock();
+    stream->queued = microseconds;
+    lock.Unlock();
+}
+
+void StreamReader::SetLoop(ReadAheadStream* stream, bool looping,
+                           unsigned int start, unsigned int end) {
+    lock.Lock();
+    stream->looping = looping;
+    stream->loopStart = start;
+    stream->loopEnd = end;
+    lock.Unlock();
+}
+
+unsigned int StreamReader::NextPass(ReadAheadStream* stream,
+                                    unsigned int start) {
+    lock.Lock();
+    if (stream->passes.empty()) {
+        lock.Unlock();
+        Seek(stream, start);
+        return start;
+    }
+    ReadAheadStream::Pass pass = stream->passes.front();
+    stream->passes.pop_front();
+    Drop(stream, pass.bytes);
+    lock.Unlock();
+    wake.Post();
+    return pass.next;
+}
+
+void StreamReader::Seek(ReadAheadStream* stream, unsigned int frame) {
+    lock.Lock();
+    stream->head = stream->fill = 0;
+    stream->passes.clear();
+    stream->ended = false;
+    stream->restart = true;
+    stream->restartAt = frame;
+    // a read in progress is dropped when it is done
+    stream->generation++;
+    lock.Unlock();
+    wake.Post();
+}
+
+unsigned int StreamReader::GetUnderruns() {
+    return underruns;
+}
+
+/**
+ * The stream with room for a chunk that will run dry first, marked
+ * as being read. Called with the lock held.
+ */
+ReadAheadStream* StreamReader::NextStream() {
+    ReadAheadStream* next = NULL;
+    double earliest = 0.0;
+    for (unsigned int i = 0; i < streams.size(); ++i) {
+        ReadAheadStream* s = streams[i];
+        if (s->reading || s->waiting || s->ended || 
+            s->ring.size() - s->fill < CHUNK)
+            continue;
+        double deadline = s->queued + s->fill * 1000000.0 / s->byteRate;
+        if (!next || deadline < earliest) {
+            earliest = deadline;
+            next = s;
+        }
+    }
+    if (next) next->reading = true;
+    return next;
+}
+
+void StreamReader::Work(std::vector<char>& scratch) {
+    while (running) {
+        lock.Lock();
+        ReadAheadStream* stream = NextStream();
+        lock.Unlock();
+        if (!stream) {
+            wake.Wait();
+            continue;
+        }
+
+        stream->io.Lock();
+        lock.Lock();
+        // a direct read may have ended the stream meanwhile
+        bool ended = stream->ended;
+        unsigned int generation = stream->generation;
+        lock.Unlock();
+        if (!ended) {
+            bool passEnded;
+            unsigned int read = 
+                ReadResource(stream, &scratch[0], CHUNK, passEnded);
+            lock.Lock();
+            if (stream->generation == generation) {
+                Append(stream, &scratch[0], read);
+                if (passEnded) EndPass(stream);
+            } else {
+                // a seek came after the read started, it may have
+                // taken the restart meant for it
+                stream->restart = true;
+            }
+            lock.Unlock();
+        }
+        stream->io.Unlock();
+        // the stream may be deleted once this is cleared
+        lock.Lock();
+        stream->reading = false;
+        lock.Unlock();
+    }
+}
+
+} // NS Sound
+} // NS OpenEngine
@@ -0,0 +1,172 @@
+// Read-ahead of playing streaming sound resources.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OE_STREAM_READER_H_
+#define _OE_STREAM_READER_H_
+
+#include <Core/Thread.h>
+#include <Core/Mutex.h>
+#include <Resources/IStreamingSoundResource.h>
+#include <Sound/Semaphore.h>
+
+#include <deque>
+#include <vector>
+
+namespace OpenEngine {
+namespace Sound {
+
+using OpenEngine::Core::Thread;
+using OpenEngine::Core::Mutex;
+using OpenEngine::Resources::IStreamingSoundResourcePtr;
+
+/**
+ * A stream attached to the reader, with the data read ahead of the
+ * player in a ring buffer. When looping, the ring can hold the ends
+ * of passes through the stream, each followed by the next pass.
+ */
+class ReadAheadStream {
+public:
+    class Pass {
+    public:
+        unsigned int bytes; // left in the ring up to its end
+        unsigned int next;  // frame the next pass starts at
+        Pass(unsigned int bytes, unsigned int next)
+            : bytes(bytes), next(next) {}
+    };
+
+    IStreamingSoundResourcePtr resource;
+    Mutex io;               // held while the resource is read
+    std::vector<char> ring;
+    unsigned int head;      // first unread byte
+    unsigned int fill;      // unread bytes
+    unsigned int frameSize;
+    unsigned int byteRate;  // bytes played per second
+    unsigned int queued;    // microseconds queued beyond the ring
+    bool ended;             // the resource has no more data
+    bool reading;           // a worker is reading the resource
+    bool waiting;           // the player waits to read it itself
+    std::deque<Pass> passes; // passes that end in the ring
+    bool looping;
+    unsigned int loopStart;
+    unsigned int loopEnd;   // zero for the end of the resource
+    bool restart;           // start the resource over at restartAt
+    unsigned int restartAt;
+    unsigned int generation; // counts drops of the read-ahead data
+    // frames of the resource read, and of those in this pass, only
+    // touched holding io
+    unsigned int position;
+    unsigned int passFrames;
+
+    ReadAheadStream(IStreamingSoundResourcePtr resource,
+                    unsigned int capacity, unsigned int frameSize,
+                    unsigned int byteRate, unsigned int position)
+        : resource(resource), ring(capacity), head(0), fill(0)
+        , frameSize(frameSize), byteRate(byteRate), queued(0)
+        , ended(false), reading(false), waiting(false), looping(false)
+        , loopStart(0), loopEnd(0), restart(false), restartAt(0)
+        , generation(0), position(position), passFrames(position) {}
+};
+
+/**
+ * Stream reader.
+ * Reads attached streams ahead of their players on a pool of
+ * worker threads, so slow reads of the resources do not stall the
+ * caller. Each stream gets a ring buffer, and the workers top up
+ * the stream that will run dry first, counting the time its player
+ * has queued as well as the ring. Reads the ring cannot cover are
+ * done by the caller, so the data is never late, only slow in the
+ * worst case. While a stream is attached only the reader may touch
+ * its resource. Idle workers sleep until a stream is attached or
+ * read from.
+ *
+ * Resources cannot seek, so a looping stream is started over by
+ * reloading the resource and reading up to the loop start. The
+ * workers do that too, and go on reading the next pass into the
+ * ring, so the player does not wait for the reload. Reads stop at
+ * the end of each pass, as they do at the end of a stream, and
+ * NextPass moves on to the next one.
+ *
+ * @class StreamReader StreamReader.h Sound/StreamReader.h
+ */
+class StreamReader {
+private:
+    static const unsigned int CHUNK = 32 * 1024;
+
+    class Worker : public Thread {
+    public:
+        StreamReader* reader;
+        std::vector<char> scratch;
+        Worker(StreamReader* reader): reader(reader), scratch(CHUNK) {}
+        void Run() { reader->Work(scratch); }
+    };
+
+    friend class Worker;
+
+    Mutex lock;
+    Semaphore wake;
+    std::vector<ReadAheadStream*> streams;
+    std::vector<Worker*> workers;
+    volatile bool running;
+    unsigned int underruns;
+
+    void Append(ReadAheadStream* stream, const char* data, unsigned int size);
+    void Drop(ReadAheadStream* stream, unsigned int size);
+    unsigned int ReadResource(ReadAheadStream* stream, char* buf,
+                              unsigned int size, bool& passEnded);
+    void EndPass(ReadAheadStream* stream);
+    ReadAheadStream* NextStream();
+    void Work(std::vector<char>& scratch);
+
+public:
+    StreamReader();
+    ~StreamReader();
+
+    //! Start the given number of workers.
+    void Start(unsigned int threads = 1);
+    void Stop();
+    bool IsRunning();
+
+    /**
+     * Start reading ahead capacity bytes of the resource, which has
+     * been read up to the given frame. Attach a stream some time
+     * before its first read, so the workers have filled the ring by
+     * then.
+     */
+    ReadAheadStream* Attach(IStreamingSoundResourcePtr resource,
+                            unsigned int capacity, unsigned int position = 0);
+    //! Stop reading, hand the resource back and delete the stream.
+    void Detach(ReadAheadStream* stream);
+
+    //! Read up to size bytes, short only at the end of a pass.
+    unsigned int Read(ReadAheadStream* stream, char* buf, unsigned int size);
+    /**
+     * Loop between two frames at the end of each pass, the end
+     * exclusive and zero for the end of the resource. Passes already
+     * read keep the loop points they were read with.
+     */
+    void SetLoop(ReadAheadStream* stream, bool looping,
+                 unsigned int start, unsigned int end);
+    /**
+     * Move on from the end of a pass, dropping what is left of it.
+     * If the next pass has not been read the resource is started
+     * over at start. Returns the frame the next pass starts at.
+     */
+    unsigned int NextPass(ReadAheadStream* stream, unsigned int start);
+    //! Drop the data read ahead and go on from a frame of the resource.
+    void Seek(ReadAheadStream* stream, unsigned int frame);
+    //! Tell how long the player can go on without the stream.
+    void SetQueued(ReadAheadStream* stream, unsigned int microseconds);
+    //! Reads the caller had to make itself.
+    unsigned int GetUnderruns();
+};
+
+} // NS Sound
+} // NS OpenEngine
+
+#endif // _OE_STREAM_READER_H_
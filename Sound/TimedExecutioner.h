@@ -33,54 +33,79 @@ class InternalStruct {
     T to;
     Utils::Time duration;
     Utils::Time time;
- InternalStruct(RWValue<T>* rwvalue, T from, T to, Time duration, Time time)
-     : rwvalue(rwvalue), from(from), to(to), duration(duration), time(time) { }
+    bool owned;
+ InternalStruct(RWValue<T>* rwvalue, T from, T to, Time duration, Time time, bool owned)
+     : rwvalue(rwvalue), from(from), to(to), duration(duration), time(time), owned(owned) { }
 };
 
+/**
+ * Interpolates values from one value to another over time. The value
+ * is set every process event until the duration has passed, and then
+ * set to the final value. Values added as owned are deleted when
+ * their interpolation ends.
+ */
 template <class T>
     class TimedExecutioner : public OpenEngine::Core::IListener<OpenEngine::Core::ProcessEventArg> {
  protected:
     Utils::Timer timer;
     std::list<InternalStruct<T>*> internals;
+
+    void Release(InternalStruct<T>* element) {
+        if (element->owned) delete element->rwvalue;
+        delete element;
+    }
  public:
     TimedExecutioner() { 
         timer.Start();
     }
 
-    void Add(RWValue<T>* rwvalue, T from, T to, Utils::Time duration) {
+    virtual ~TimedExecutioner() {
+        for (typename std::list<InternalStruct<T> * >::iterator iter = internals.begin(); 
+             iter != internals.end(); iter++)
+            Release(*iter);
+    }
+
+    void Add(RWValue<T>* rwvalue, T from, T to, Utils::Time duration, bool owned = true) {
         Utils::Time time = timer.GetElapsedTime();
-        internals.push_back( new InternalStruct<T>(rwvalue, from, to, duration, time) );
+        internals.push_back( new InternalStruct<T>(rwvalue, from, to, duration, time, owned) );
+    }
+
+    /**
+     * Stop interpolating the value, leaving it where it is.
+     */
+    void Cancel(RWValue<T>* rwvalue) {
+        typename std::list<InternalStruct<T> * >::iterator iter = internals.begin();
+        while (iter != internals.end()) {
+            if ((*iter)->rwvalue == rwvalue) {
+                Release(*iter);
+                iter = internals.erase(iter);
+            }
+            else iter++;
+        }
     }
 
     void Handle(OpenEngine::Core::ProcessEventArg arg) {
         Utils::Time currentTime = timer.GetElapsedTime();
-        std::list<InternalStruct<T>*> deletionList;
 
-        for (typename std::list<InternalStruct<T> * >::iterator iter = internals.begin(); 
-             iter != internals.end(); iter++) {
+        typename std::list<InternalStruct<T> * >::iterator iter = internals.begin();
+        while (iter != internals.end()) {
             InternalStruct<T>* currentElement = *iter;
+            RWValue<T>* rwvalue = currentElement->rwvalue;
 
             Utils::Time stopTime = currentElement->time + currentElement->duration;
-            if (stopTime > currentTime) {
-                deletionList.push_back(currentElement);
-            } else {
-                if ( currentTime < currentElement->time ) {
-                    throw Core::Exception("current time is in the past!");
-                } else {
-                    float interpolator = (float)(currentTime - currentElement->time).AsInt64() / (float)currentElement->duration.AsInt64();
-                    logger.info << "Setting value to: " << interpolator << logger.end;
-                    RWValue<T>* rwvalue = currentElement->rwvalue;
-                    T from = currentElement->from;
-                    T to = currentElement->to;
-                    rwvalue->Set((to-from)*interpolator+from);
-                }
+            if (currentTime >= stopTime) {
+                rwvalue->Set(currentElement->to);
+                Release(currentElement);
+                iter = internals.erase(iter);
+                continue;
             }
-        }
-
-        for (typename std::list<InternalStruct<T>*>::iterator iter = deletionList.begin(); 
-             iter != deletionList.end(); iter++) {
-            InternalStruct<T>* currentElement = *iter;
-            internals.remove(currentElement);
+            if ( currentTime < currentElement->time )
+                throw Core::Exception("current time is in the past!");
+            float interpolator = (float)(currentTime - currentElement->time).AsInt64() / (float)currentElement->duration.AsInt64();
+            T from = currentElement->from;
+            T to = currentElement->to;
+            rwvalue->Set((to-from)*interpolator+from);
+            iter++;
         }
     }
 };
@@ -0,0 +1,109 @@
+// Benchmark of the emitter grid used for distance culling.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+// Usage: EmitterGridBench [emitters ...] [--range units]
+//
+// Scatters emitters over a 20000 x 200 x 20000 world and times, per
+// frame, a radius query around a moving listener against a linear
+// scan of every emitter, a nearest-16 query within the range, and
+// moving every emitter a little. The default runs 10000 and 50000
+// emitters with a range of 1000 units, the sizes the culling pass
+// is meant for.
+
+#include <Sound/SpatialGrid.h>
+#include <Utils/Timer.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace OpenEngine::Sound;
+using OpenEngine::Math::Vector;
+using OpenEngine::Utils::Time;
+using OpenEngine::Utils::Timer;
+using std::vector;
+
+static Timer timer;
+
+static double Since(Time start, unsigned int frames) {
+    return (double)(timer.GetElapsedTime() - start).AsInt64() / frames;
+}
+
+static void Bench(unsigned int count, float range) {
+    const unsigned int frames = 1000;
+    SpatialGrid grid;
+    grid.Reserve(count);
+    vector<Vector<3,float> > position(count);
+    srand(1);
+    for (unsigned int i = 0; i < count; ++i) {
+        position[i] = Vector<3,float>(rand() % 20000 - 10000.0, rand() % 200,
+                                      rand() % 20000 - 10000.0);
+        grid.Insert(i, position[i]);
+    }
+
+    vector<unsigned int> found;
+    unsigned long hits = 0;
+    Time start = timer.GetElapsedTime();
+    for (unsigned int f = 0; f < frames; ++f) {
+        found.clear();
+        grid.QueryRadius(Vector<3,float>(f % 1000, 50.0, 0.0), range, found);
+        hits += found.size();
+    }
+    double query = Since(start, frames);
+
+    unsigned long scanned = 0;
+    start = timer.GetElapsedTime();
+    for (unsigned int f = 0; f < frames; ++f) {
+        Vector<3,float> listener(f % 1000, 50.0, 0.0);
+        for (unsigned int i = 0; i < count; ++i)
+            if ((position[i] - listener).GetLengthSquared() <= range * range)
+                scanned++;
+    }
+    double scan = Since(start, frames);
+
+    start = timer.GetElapsedTime();
+    for (unsigned int f = 0; f < frames; ++f) {
+        found.clear();
+        grid.QueryNearest(Vector<3,float>(f % 1000, 50.0, 0.0), 16, range, found);
+    }
+    double nearest = Since(start, frames);
+
+    start = timer.GetElapsedTime();
+    for (unsigned int f = 0; f < frames; ++f)
+        for (unsigned int i = 0; i < count; ++i)
+            grid.Move(i, position[i] + Vector<3,float>(f % 7, 0.0, f % 5));
+    double move = Since(start, frames);
+
+    std::cout << count << " emitters: radius query " << query << " us ("
+              << hits / frames << " in range), linear scan " << scan
+              << " us (" << scanned / frames << "), nearest 16 " << nearest
+              << " us, moving all " << move << " us" << std::endl;
+    if (hits != scanned)
+        std::cout << "  the query and the scan disagree" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    vector<unsigned int> counts;
+    float range = 1000.0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--range") == 0 && i + 1 < argc)
+            range = atof(argv[++i]);
+        else
+            counts.push_back(strtoul(argv[i], NULL, 10));
+    }
+    if (counts.empty()) {
+        counts.push_back(10000);
+        counts.push_back(50000);
+    }
+    timer.Start();
+    for (unsigned int i = 0; i < counts.size(); ++i)
+        Bench(counts[i], range);
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Benchmark of one-shot plays on an OpenAL device.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+// Usage: OneShotBench [plays per second] [seconds] [voices]
+//
+// Fires short positional one-shots at the given rate from a 60 Hz
+// frame loop on the default device, and reports the time taken by
+// PlayOneShot and by the updates, the plays dropped for want of a
+// voice, and the allocations made by the plays. Each frame runs a
+// process update and the listener part of a rendering update, as an
+// engine frame does, so voices are culled and recycled as in a game.
+// After the first second every play should be free of allocations.
+
+#include <Sound/OpenALSoundSystem.h>
+#include <Core/EngineEvents.h>
+#include <Core/Thread.h>
+#include <Utils/Timer.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+using namespace OpenEngine::Sound;
+using OpenEngine::Core::InitializeEventArg;
+using OpenEngine::Core::ProcessEventArg;
+using OpenEngine::Core::DeinitializeEventArg;
+using OpenEngine::Core::Thread;
+using OpenEngine::Resources::ISoundResource;
+using OpenEngine::Resources::ISoundResourcePtr;
+using OpenEngine::Resources::SoundFormat;
+using OpenEngine::Resources::MONO;
+using OpenEngine::Utils::Time;
+using OpenEngine::Utils::Timer;
+using OpenEngine::Math::Vector;
+using OpenEngine::Math::Quaternion;
+using std::vector;
+
+// every allocation of the process is counted
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    free(p);
+}
+
+/**
+ * A 16 bit mono tone held in memory.
+ */
+class ToneResource : public ISoundResource {
+private:
+    unsigned int frequency;
+    vector<short> samples;
+public:
+    ToneResource(unsigned int frequency, unsigned int frames)
+        : frequency(frequency), samples(frames) {
+        for (unsigned int i = 0; i < frames; ++i)
+            samples[i] = (short)(8000.0 * sin(i * 2.0 * 3.14159265 * 440.0 / frequency));
+    }
+    char* GetBuffer() { return (char*)&samples[0]; }
+    unsigned int GetBufferSize() { return samples.size() * sizeof(short); }
+    unsigned int GetFrequency() { return frequency; }
+    unsigned int GetBitsPerSample() { return 16; }
+    SoundFormat GetFormat() { return MONO; }
+    void Load() {}
+    void Unload() {}
+};
+
+int main(int argc, char** argv) {
+    unsigned int rate = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    unsigned int seconds = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+    unsigned int pool = argc > 3 ? strtoul(argv[3], NULL, 10) : 128;
+    const unsigned int updatesPerSecond = 60;
+
+    OpenALSoundSystem system;
+    system.SetOneShotVoices(pool);
+    system.Handle(InitializeEventArg());
+    // 50 ms clicks, so the pool is recycled many times a second
+    ISoundResourcePtr click(new ToneResource(44100, 2205));
+    // upload the buffer before measuring
+    system.PlayOneShot(click, Vector<3,float>(0.0, 0.0, 0.0), 0.0, 1.0);
+
+    Timer timer;
+    timer.Start();
+    uint64_t playTime = 0, worstPlay = 0, updateTime = 0, worstUpdate = 0;
+    unsigned long plays = 0, played = 0, playAllocations = 0;
+    unsigned int updates = seconds * updatesPerSecond;
+    uint64_t frame = 1000000 / updatesPerSecond;
+    srand(1);
+    for (unsigned int u = 0; u < updates; ++u) {
+        Time start = timer.GetElapsedTime();
+        // spread the plays evenly over the updates
+        unsigned int count = (u + 1) * rate / updatesPerSecond
+            - u * rate / updatesPerSecond;
+        bool warm = u >= updatesPerSecond;
+        if (u == updatesPerSecond)
+            system.ResetStats();
+        for (unsigned int i = 0; i < count; ++i) {
+            Vector<3,float> position(rand() % 2000 - 1000.0, 0.0,
+                                     rand() % 2000 - 1000.0);
+            unsigned long before = allocations;
+            Time t0 = timer.GetElapsedTime();
+            bool ok = system.PlayOneShot(click, position, 0.2, 1.0);
+            uint64_t took = (timer.GetElapsedTime() - t0).AsInt64();
+            if (!warm) continue;
+            playAllocations += allocations - before;
+            plays++;
+            if (ok) played++;
+            playTime += took;
+            if (took > worstPlay) worstPlay = took;
+        }
+
+        Time t0 = timer.GetElapsedTime();
+        system.Handle(ProcessEventArg(t0, frame));
+        system.UpdateListener(Vector<3,float>(0.0, 0.0, 0.0), Quaternion<float>());
+        uint64_t took = (timer.GetElapsedTime() - t0).AsInt64();
+        if (warm) {
+            updateTime += took;
+            if (took > worstUpdate) worstUpdate = took;
+        }
+        uint64_t spent = (timer.GetElapsedTime() - start).AsInt64();
+        if (spent < frame)
+            Thread::Sleep(frame - spent);
+    }
+    OpenALSoundSystem::Stats stats = system.GetStats();
+    system.Handle(DeinitializeEventArg());
+
+    unsigned int measured = updates > updatesPerSecond ? updates - updatesPerSecond : 0;
+    std::cout << "one-shots: " << plays << " fired, " << played << " played, "
+              << stats.oneShotsDropped << " dropped for want of a voice" << std::endl;
+    if (plays)
+        std::cout << "PlayOneShot: " << (double)playTime / plays << " us mean, "
+                  << worstPlay << " us worst, " << playAllocations
+                  << " allocations" << std::endl;
+    if (measured)
+        std::cout << "update: " << (double)updateTime / measured << " us mean, "
+                  << worstUpdate << " us worst" << std::endl;
+    return playAllocations ? 1 : 0;
+}
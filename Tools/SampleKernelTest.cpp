@@ -0,0 +1,406 @@
+// Correctness test and benchmark of the sample kernels.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+// Usage: SampleKernelTest [--bench [samples]]
+//
+// Runs every convert, downmix, deinterleave, gain and decimate
+// kernel over random data, extremes included, for all sample types
+// and channel counts, and compares the output with scalar reference
+// code that branches on the format per sample. Integer results may
+// differ by one step, float results by rounding. With --bench each
+// kernel and its reference are timed as well. Exits non-zero on any
+// mismatch.
+
+#include <Sound/SampleKernels.h>
+#include <Utils/Timer.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine::Sound;
+using OpenEngine::Utils::Time;
+using OpenEngine::Utils::Timer;
+using std::string;
+using std::vector;
+
+static const SampleFormat::Type TYPES[3] = {
+    SampleFormat::INT8, SampleFormat::INT16, SampleFormat::FLOAT32
+};
+static const char* TYPE_NAMES[3] = { "int8", "int16", "float" };
+
+// left and right weights of each channel folded to stereo, in
+// OpenAL channel order
+static const float MONO[1][2] = { {1,1} };
+static const float STEREO[2][2] = { {1,0}, {0,1} };
+static const float THREE[3][2] = { {1,0}, {0,1}, {0.707f,0.707f} };
+static const float QUAD[4][2] = { {1,0}, {0,1}, {0.707f,0}, {0,0.707f} };
+static const float FIVE[5][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0.707f,0}, {0,0.707f} };
+static const float SURROUND51[6][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0,0}, {0.707f,0}, {0,0.707f} };
+static const float SURROUND61[7][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0,0}, {0.5f,0.5f}, {0.707f,0}, {0,0.707f} };
+static const float SURROUND71[8][2] =
+    { {1,0}, {0,1}, {0.707f,0.707f}, {0,0}, {0.707f,0}, {0,0.707f}, {0.707f,0}, {0,0.707f} };
+
+static const float* Weights(unsigned int channels) {
+    switch (channels) {
+    case 1: return &MONO[0][0];
+    case 2: return &STEREO[0][0];
+    case 3: return &THREE[0][0];
+    case 4: return &QUAD[0][0];
+    case 5: return &FIVE[0][0];
+    case 6: return &SURROUND51[0][0];
+    case 7: return &SURROUND61[0][0];
+    default: return &SURROUND71[0][0];
+    }
+}
+
+// the scalar reference, branching on the type of every sample
+
+static float ReadRef(SampleFormat::Type type, const char* data, unsigned int i) {
+    if (type == SampleFormat::INT8)
+        return ((int)((const unsigned char*)data)[i] - 128) / 128.0f;
+    else if (type == SampleFormat::INT16)
+        return ((const short*)data)[i] / 32768.0f;
+    return ((const float*)data)[i];
+}
+
+static void WriteRef(SampleFormat::Type type, char* data, unsigned int i, float v) {
+    if (type == SampleFormat::INT8) {
+        float s = v * 128.0f + 128.0f;
+        if (s < 0.0f) s = 0.0f;
+        if (s > 255.0f) s = 255.0f;
+        ((unsigned char*)data)[i] = (unsigned char)s;
+    }
+    else if (type == SampleFormat::INT16) {
+        float s = v * 32768.0f;
+        if (s < -32768.0f) s = -32768.0f;
+        if (s > 32767.0f) s = 32767.0f;
+        ((short*)data)[i] = (short)s;
+    }
+    else
+        ((float*)data)[i] = v;
+}
+
+static void ConvertRef(SampleFormat::Type from, SampleFormat::Type to,
+                       const char* in, char* out, unsigned int samples) {
+    for (unsigned int i = 0; i < samples; ++i)
+        WriteRef(to, out, i, ReadRef(from, in, i));
+}
+
+static void DownmixRef(SampleFormat from, SampleFormat::Type to,
+                       const char* in, char* out, unsigned int frames) {
+    const float* weights = Weights(from.channels);
+    for (unsigned int f = 0; f < frames; ++f) {
+        float left = 0.0f, right = 0.0f;
+        for (unsigned int c = 0; c < from.channels; ++c) {
+            float v = ReadRef(from.type, in, f * from.channels + c);
+            left += v * weights[c * 2];
+            right += v * weights[c * 2 + 1];
+        }
+        WriteRef(to, out, 2 * f, left);
+        WriteRef(to, out, 2 * f + 1, right);
+    }
+}
+
+static void DeinterleaveRef(SampleFormat format, const char* in, char** out,
+                            unsigned int frames) {
+    unsigned int size = format.BytesPerSample();
+    for (unsigned int f = 0; f < frames; ++f)
+        for (unsigned int c = 0; c < format.channels; ++c)
+            memcpy(out[c] + f * size, in + (f * format.channels + c) * size, size);
+}
+
+static void GainRef(SampleFormat::Type type, char* data, unsigned int samples,
+                    float gain) {
+    for (unsigned int i = 0; i < samples; ++i)
+        WriteRef(type, data, i, ReadRef(type, data, i) * gain);
+}
+
+static void DecimateRef(SampleFormat::Type from, SampleFormat::Type to,
+                        const char* in, char* out, unsigned int samples,
+                        unsigned int factor) {
+    for (unsigned int i = 0; i < samples / factor; ++i) {
+        float sum = 0.0f;
+        for (unsigned int j = 0; j < factor; ++j)
+            sum += ReadRef(from, in, i * factor + j);
+        WriteRef(to, out, i, sum * (1.0f / factor));
+    }
+}
+
+// random samples, a few of them at or beyond full scale
+static vector<char> Noise(SampleFormat::Type type, unsigned int samples) {
+    vector<char> data(samples * SampleFormat(1, type).BytesPerSample() + 1);
+    for (unsigned int i = 0; i < samples; ++i) {
+        float v = (rand() % 20001 - 10000) / 10000.0f;
+        if (i % 97 == 0) v = (i % 2) ? 1.5f : -1.5f;
+        if (type == SampleFormat::INT8)
+            ((unsigned char*)&data[0])[i] = i % 89 == 0 ? (i % 2 ? 255 : 0) : rand() % 256;
+        else if (type == SampleFormat::INT16)
+            ((short*)&data[0])[i] = i % 89 == 0 ? (i % 2 ? 32767 : -32768)
+                                                : (short)(rand() % 65536 - 32768);
+        else
+            ((float*)&data[0])[i] = v;
+    }
+    return data;
+}
+
+static unsigned int failures = 0;
+
+static bool Same(SampleFormat::Type type, const char* a, const char* b,
+                 unsigned int samples) {
+    for (unsigned int i = 0; i < samples; ++i) {
+        float x = ReadRef(type, a, i), y = ReadRef(type, b, i);
+        float step = type == SampleFormat::INT8 ? 1.0f / 128.0f
+            : (type == SampleFormat::INT16 ? 1.0f / 32768.0f
+               : 1e-6f * (fabs(x) > 1.0f ? fabs(x) : 1.0f));
+        if (fabs(x - y) > step * 1.001f)
+            return false;
+    }
+    return true;
+}
+
+static void Check(bool ok, const string& what) {
+    if (ok) return;
+    std::cout << "FAIL " << what << std::endl;
+    failures++;
+}
+
+static string Name(const char* kernel, unsigned int from, unsigned int to,
+                   unsigned int channels) {
+    string name = string(kernel) + " " + TYPE_NAMES[from];
+    if (to < 3) name += string(" to ") + TYPE_NAMES[to];
+    if (channels) name += " " + string(1, (char)('0' + channels)) + " channels";
+    return name;
+}
+
+static void TestConvert(unsigned int samples) {
+    for (unsigned int f = 0; f < 3; ++f)
+        for (unsigned int t = 0; t < 3; ++t) {
+            SampleKernels::ConvertFunc kernel = SampleKernels::Converter(TYPES[f], TYPES[t]);
+            string name = Name("convert", f, t, 0);
+            Check(kernel != NULL, name + " missing");
+            if (!kernel) continue;
+            vector<char> in = Noise(TYPES[f], samples);
+            unsigned int size = samples * SampleFormat(1, TYPES[t]).BytesPerSample();
+            vector<char> got(size + 1), want(size + 1);
+            kernel(&in[0], &got[0], samples);
+            ConvertRef(TYPES[f], TYPES[t], &in[0], &want[0], samples);
+            Check(Same(TYPES[t], &got[0], &want[0], samples), name);
+        }
+}
+
+static void TestDownmix(unsigned int frames) {
+    for (unsigned int c = 1; c <= SampleFormat::MAX_CHANNELS; ++c)
+        for (unsigned int f = 0; f < 3; ++f)
+            for (unsigned int t = 0; t < 3; ++t) {
+                SampleFormat from(c, TYPES[f]);
+                SampleKernels::DownmixFunc kernel = SampleKernels::Downmixer(from, TYPES[t]);
+                string name = Name("downmix", f, t, c);
+                Check(kernel != NULL, name + " missing");
+                if (!kernel) continue;
+                vector<char> in = Noise(TYPES[f], frames * c);
+                unsigned int size = frames * SampleFormat(2, TYPES[t]).FrameSize();
+                vector<char> got(size + 1), want(size + 1);
+                kernel(&in[0], &got[0], frames);
+                DownmixRef(from, TYPES[t], &in[0], &want[0], frames);
+                Check(Same(TYPES[t], &got[0], &want[0], frames * 2), name);
+            }
+    Check(SampleKernels::Downmixer(SampleFormat(0), SampleFormat::INT16) == NULL,
+          "downmix of no channels exists");
+    Check(SampleKernels::Downmixer(SampleFormat(SampleFormat::MAX_CHANNELS + 1),
+                                   SampleFormat::INT16) == NULL,
+          "downmix of too many channels exists");
+}
+
+static void TestDeinterleave(unsigned int frames) {
+    for (unsigned int c = 1; c <= SampleFormat::MAX_CHANNELS; ++c)
+        for (unsigned int f = 0; f < 3; ++f) {
+            SampleFormat format(c, TYPES[f]);
+            SampleKernels::DeinterleaveFunc kernel = SampleKernels::Deinterleaver(format);
+            string name = Name("deinterleave", f, 3, c);
+            Check(kernel != NULL, name + " missing");
+            if (!kernel) continue;
+            vector<char> in = Noise(TYPES[f], frames * c);
+            unsigned int size = frames * format.BytesPerSample();
+            vector<vector<char> > got(c, vector<char>(size + 1));
+            vector<vector<char> > want(c, vector<char>(size + 1));
+            vector<char*> gotp(c), wantp(c);
+            for (unsigned int i = 0; i < c; ++i) {
+                gotp[i] = &got[i][0];
+                wantp[i] = &want[i][0];
+            }
+            kernel(&in[0], &gotp[0], frames);
+            DeinterleaveRef(format, &in[0], &wantp[0], frames);
+            bool ok = true;
+            for (unsigned int i = 0; i < c; ++i)
+                ok = ok && memcmp(gotp[i], wantp[i], size) == 0;
+            Check(ok, name);
+        }
+    Check(SampleKernels::Deinterleaver(SampleFormat(SampleFormat::MAX_CHANNELS + 1)) == NULL,
+          "deinterleave of too many channels exists");
+}
+
+static void TestGain(unsigned int samples) {
+    const float gains[4] = { 0.0f, 0.5f, 1.0f, 2.5f };
+    for (unsigned int f = 0; f < 3; ++f) {
+        SampleKernels::GainFunc kernel = SampleKernels::Gainer(TYPES[f]);
+        string name = Name("gain", f, 3, 0);
+        Check(kernel != NULL, name + " missing");
+        if (!kernel) continue;
+        for (unsigned int g = 0; g < 4; ++g) {
+            vector<char> got = Noise(TYPES[f], samples);
+            vector<char> want = got;
+            kernel(&got[0], samples, gains[g]);
+            GainRef(TYPES[f], &want[0], samples, gains[g]);
+            Check(Same(TYPES[f], &got[0], &want[0], samples), name);
+        }
+    }
+}
+
+static void TestDecimate(unsigned int samples) {
+    for (unsigned int f = 0; f < 3; ++f)
+        for (unsigned int t = 0; t < 3; ++t) {
+            SampleKernels::DecimateFunc kernel = SampleKernels::Decimator(TYPES[f], TYPES[t]);
+            string name = Name("decimate", f, t, 0);
+            Check(kernel != NULL, name + " missing");
+            if (!kernel) continue;
+            for (unsigned int factor = 2; factor <= 4; factor += 2) {
+                vector<char> in = Noise(TYPES[f], samples);
+                unsigned int size = (samples / factor) * SampleFormat(1, TYPES[t]).BytesPerSample();
+                vector<char> got(size + 1), want(size + 1);
+                kernel(&in[0], &got[0], samples, factor);
+                DecimateRef(TYPES[f], TYPES[t], &in[0], &want[0], samples, factor);
+                Check(Same(TYPES[t], &got[0], &want[0], samples / factor), name);
+            }
+        }
+}
+
+// microseconds per call of a kernel and of its reference
+
+static Timer timer;
+
+static double Since(Time start, unsigned int runs) {
+    return (double)(timer.GetElapsedTime() - start).AsInt64() / runs;
+}
+
+static void Report(const string& name, double kernel, double reference,
+                   unsigned int bytes) {
+    std::cout << name << ": " << kernel << " us, "
+              << (kernel > 0.0 ? bytes / kernel : 0.0) << " MB/s, "
+              << (kernel > 0.0 ? reference / kernel : 0.0)
+              << "x the reference" << std::endl;
+}
+
+static void Bench(unsigned int samples) {
+    const unsigned int runs = 20;
+    for (unsigned int f = 0; f < 3; ++f)
+        for (unsigned int t = 0; t < 3; ++t) {
+            vector<char> in = Noise(TYPES[f], samples);
+            vector<char> out(samples * 4 + 1);
+            SampleKernels::ConvertFunc kernel = SampleKernels::Converter(TYPES[f], TYPES[t]);
+            Time start = timer.GetElapsedTime();
+            for (unsigned int r = 0; r < runs; ++r)
+                kernel(&in[0], &out[0], samples);
+            double k = Since(start, runs);
+            start = timer.GetElapsedTime();
+            for (unsigned int r = 0; r < runs; ++r)
+                ConvertRef(TYPES[f], TYPES[t], &in[0], &out[0], samples);
+            Report(Name("convert", f, t, 0), k, Since(start, runs),
+                   samples * SampleFormat(1, TYPES[f]).BytesPerSample());
+        }
+    for (unsigned int c = 1; c <= SampleFormat::MAX_CHANNELS; ++c)
+        for (unsigned int f = 0; f < 3; ++f) {
+            SampleFormat from(c, TYPES[f]);
+            unsigned int frames = samples / c;
+            vector<char> in = Noise(TYPES[f], frames * c);
+            vector<char> out(frames * 8 + 1);
+            SampleKernels::DownmixFunc kernel = SampleKernels::Downmixer(from, SampleFormat::INT16);
+            Time start = timer.GetElapsedTime();
+            for (unsigned int r = 0; r < runs; ++r)
+                kernel(&in[0], &out[0], frames);
+            double k = Since(start, runs);
+            start = timer.GetElapsedTime();
+            for (unsigned int r = 0; r < runs; ++r)
+                DownmixRef(from, SampleFormat::INT16, &in[0], &out[0], frames);
+            Report(Name("downmix", f, 1, c), k, Since(start, runs),
+                   frames * from.FrameSize());
+
+            vector<vector<char> > split(c, vector<char>(frames * 4 + 1));
+            vector<char*> splitp(c);
+            for (unsigned int i = 0; i < c; ++i)
+                splitp[i] = &split[i][0];
+            SampleKernels::DeinterleaveFunc deinterleave = SampleKernels::Deinterleaver(from);
+            start = timer.GetElapsedTime();
+            for (unsigned int r = 0; r < runs; ++r)
+                deinterleave(&in[0], &splitp[0], frames);
+            k = Since(start, runs);
+            start = timer.GetElapsedTime();
+            for (unsigned int r = 0; r < runs; ++r)
+                DeinterleaveRef(from, &in[0], &splitp[0], frames);
+            Report(Name("deinterleave", f, 3, c), k, Since(start, runs),
+                   frames * from.FrameSize());
+        }
+    for (unsigned int f = 0; f < 3; ++f) {
+        vector<char> data = Noise(TYPES[f], samples);
+        SampleKernels::GainFunc kernel = SampleKernels::Gainer(TYPES[f]);
+        Time start = timer.GetElapsedTime();
+        for (unsigned int r = 0; r < runs; ++r)
+            kernel(&data[0], samples, 0.99f);
+        double k = Since(start, runs);
+        start = timer.GetElapsedTime();
+        for (unsigned int r = 0; r < runs; ++r)
+            GainRef(TYPES[f], &data[0], samples, 0.99f);
+        Report(Name("gain", f, 3, 0), k, Since(start, runs),
+               samples * SampleFormat(1, TYPES[f]).BytesPerSample());
+
+        vector<char> out(samples * 4 + 1);
+        SampleKernels::DecimateFunc decimate = SampleKernels::Decimator(TYPES[f], TYPES[f]);
+        start = timer.GetElapsedTime();
+        for (unsigned int r = 0; r < runs; ++r)
+            decimate(&data[0], &out[0], samples, 4);
+        k = Since(start, runs);
+        start = timer.GetElapsedTime();
+        for (unsigned int r = 0; r < runs; ++r)
+            DecimateRef(TYPES[f], TYPES[f], &data[0], &out[0], samples, 4);
+        Report(Name("decimate", f, f, 0), k, Since(start, runs),
+               samples * SampleFormat(1, TYPES[f]).BytesPerSample());
+    }
+}
+
+int main(int argc, char** argv) {
+    srand(1);
+    // odd lengths, so loops with unrolled bodies are checked at their
+    // tails too
+    const unsigned int lengths[3] = { 1, 7, 4099 };
+    for (unsigned int i = 0; i < 3; ++i) {
+        TestConvert(lengths[i]);
+        TestDownmix(lengths[i]);
+        TestDeinterleave(lengths[i]);
+        TestGain(lengths[i]);
+        TestDecimate(lengths[i] + 3);
+    }
+    if (failures) {
+        std::cout << failures << " kernel checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all kernels match the reference" << std::endl;
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        unsigned int samples = argc > 2 ? strtoul(argv[2], NULL, 10) : 1 << 20;
+        timer.Start();
+        Bench(samples);
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+// Benchmark of opening a sound bank against loose wave files.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+// Usage: SoundBankBench directory [clips] [bytes]
+//
+// Writes the given number of mono 16 bit wave files of the given
+// size to the directory, 500 of 100 KB by default, and packs them
+// into a bank there. Then times opening the bank and looking up
+// every clip, against reading every loose file into memory. Neither
+// side decodes anything. Each is run with the files dropped from
+// the page cache first, where the system allows it, and again with
+// them cached.
+
+#include <Sound/SoundBank.h>
+#include <Utils/Timer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace OpenEngine::Sound;
+using OpenEngine::Utils::Time;
+using OpenEngine::Utils::Timer;
+using std::string;
+using std::vector;
+
+static Timer timer;
+
+static void Write32(std::ofstream& out, uint32_t value) {
+    char b[4] = { char(value), char(value >> 8), char(value >> 16), char(value >> 24) };
+    out.write(b, 4);
+}
+
+static void Write16(std::ofstream& out, uint16_t value) {
+    char b[2] = { char(value), char(value >> 8) };
+    out.write(b, 2);
+}
+
+static void WriteWave(string path, const vector<char>& samples) {
+    std::ofstream out(path.c_str(), std::ios::binary);
+    out.write("RIFF", 4);
+    Write32(out, 36 + samples.size());
+    out.write("WAVEfmt ", 8);
+    Write32(out, 16);
+    Write16(out, 1);            // PCM
+    Write16(out, 1);            // mono
+    Write32(out, 44100);
+    Write32(out, 44100 * 2);
+    Write16(out, 2);
+    Write16(out, 16);
+    out.write("data", 4);
+    Write32(out, samples.size());
+    out.write(&samples[0], samples.size());
+}
+
+// evict a file from the page cache, false if that is not possible
+static bool Drop(string path) {
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    fdatasync(fd);
+    bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+#else
+    return false;
+#endif
+}
+
+static double OpenBank(string path, const vector<string>& names) {
+    Time start = timer.GetElapsedTime();
+    SoundBankPtr bank = SoundBank::Open(path);
+    unsigned int found = 0;
+    for (unsigned int i = 0; i < names.size(); ++i) {
+        const SoundBank::Entry* entry = bank->Find(names[i]);
+        if (entry && bank->GetData(entry))
+            found++;
+    }
+    double ms = (timer.GetElapsedTime() - start).AsInt64() / 1000.0;
+    if (found != names.size())
+        std::cout << "  the bank is missing clips" << std::endl;
+    return ms;
+}
+
+static double ReadLoose(const vector<string>& paths) {
+    Time start = timer.GetElapsedTime();
+    vector<char> data;
+    for (unsigned int i = 0; i < paths.size(); ++i) {
+        std::ifstream in(paths[i].c_str(), std::ios::binary);
+        in.seekg(0, std::ios::end);
+        data.resize(in.tellg());
+        in.seekg(0, std::ios::beg);
+        in.read(&data[0], data.size());
+    }
+    return (timer.GetElapsedTime() - start).AsInt64() / 1000.0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "usage: SoundBankBench directory [clips] [bytes]" << std::endl;
+        return 1;
+    }
+    string dir = argv[1];
+    unsigned int clips = argc > 2 ? strtoul(argv[2], NULL, 10) : 500;
+    unsigned int bytes = argc > 3 ? strtoul(argv[3], NULL, 10) : 100 * 1024;
+    bytes -= bytes % 2;
+
+    vector<string> names, paths;
+    vector<char> samples(bytes);
+    SoundBankWriter writer;
+    SampleFormat format(1, SampleFormat::INT16);
+    for (unsigned int i = 0; i < clips; ++i) {
+        char name[32];
+        sprintf(name, "clip%04u", i);
+        for (unsigned int j = 0; j < bytes; ++j)
+            samples[j] = char(i * 31 + j * 7);
+        names.push_back(name);
+        paths.push_back(dir + "/" + name + ".wav");
+        WriteWave(paths.back(), samples);
+        writer.Add(name, format, 44100, &samples[0], bytes);
+    }
+    string bank = dir + "/bench.bank";
+    writer.Write(bank);
+    timer.Start();
+
+    std::cout << clips << " mono 16 bit clips of " << bytes << " bytes" << std::endl;
+    bool cold = Drop(bank);
+    for (unsigned int i = 0; i < paths.size(); ++i)
+        cold = Drop(paths[i]) && cold;
+    if (cold) {
+        double b = OpenBank(bank, names);
+        double l = ReadLoose(paths);
+        std::cout << "cold cache  bank " << b << " ms  loose files "
+                  << l << " ms" << std::endl;
+    } else
+        std::cout << "cold cache  not measured, the files cannot be evicted"
+                  << std::endl;
+    OpenBank(bank, names);
+    ReadLoose(paths);
+    double b = OpenBank(bank, names);
+    double l = ReadLoose(paths);
+    std::cout << "warm cache  bank " << b << " ms  loose files "
+              << l << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Offline packer of wave files into a sound bank.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+// Usage: SoundBankPacker [--adpcm-above bytes] output.bank input.wav...
+//
+// Clips are named by their file name without directory and
+// extension. 16 bit clips larger than the given size are stored IMA
+// ADPCM encoded, the rest as PCM.
+
+#include <Sound/SoundBank.h>
+#include <Core/Exceptions.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine::Sound;
+using OpenEngine::Core::Exception;
+using std::string;
+using std::vector;
+
+static uint32_t Read32(const char* p) {
+    const unsigned char* u = (const unsigned char*)p;
+    return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static uint16_t Read16(const char* p) {
+    const unsigned char* u = (const unsigned char*)p;
+    return u[0] | (u[1] << 8);
+}
+
+static string ClipName(string path) {
+    string::size_type slash = path.find_last_of("/\\");
+    if (slash != string::npos)
+        path = path.substr(slash + 1);
+    string::size_type dot = path.rfind('.');
+    if (dot != string::npos)
+        path = path.substr(0, dot);
+    return path;
+}
+
+/**
+ * Read the format and sample data of a RIFF wave file holding PCM
+ * or float samples. Returns false with a message on anything else.
+ */
+static bool ReadWave(string path, SampleFormat& format, unsigned int& frequency,
+                     vector<char>& samples, string& error) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        error = "cannot open file";
+        return false;
+    }
+    vector<char> data((std::istreambuf_iterator<char>(file)),
+                      std::istreambuf_iterator<char>());
+    if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 ||
+        memcmp(&data[8], "WAVE", 4) != 0) {
+        error = "not a wave file";
+        return false;
+    }
+    bool haveFormat = false;
+    unsigned int pos = 12;
+    while (pos + 8 <= data.size()) {
+        const char* chunk = &data[pos];
+        uint32_t size = Read32(chunk + 4);
+        if (size > data.size() - pos - 8)
+            size = data.size() - pos - 8;
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            uint16_t tag = Read16(chunk + 8);
+            uint16_t channels = Read16(chunk + 10);
+            uint16_t bits = Read16(chunk + 22);
+            frequency = Read32(chunk + 12);
+            if (tag == 1 && bits == 8)
+                format = SampleFormat(channels, SampleFormat::INT8);
+            else if (tag == 1 && bits == 16)
+                format = SampleFormat(channels, SampleFormat::INT16);
+            else if (tag == 3 && bits == 32)
+                format = SampleFormat(channels, SampleFormat::FLOAT32);
+            else {
+                error = "unsupported sample format";
+                return false;
+            }
+            haveFormat = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                error = "data before format";
+                return false;
+            }
+            samples.assign(chunk + 8, chunk + 8 + size);
+            return true;
+        }
+        // chunks are padded to even sizes
+        pos += 8 + size + (size & 1);
+    }
+    error = "no sample data";
+    return false;
+}
+
+int main(int argc, char** argv) {
+    unsigned int adpcmAbove = 0;
+    bool adpcm = false;
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "--adpcm-above") == 0) {
+        adpcm = true;
+        adpcmAbove = strtoul(argv[arg + 1], NULL, 10);
+        arg += 2;
+    }
+    if (argc - arg < 2) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--adpcm-above bytes] output.bank input.wav..." << std::endl;
+        return 1;
+    }
+    string output = argv[arg++];
+
+    SoundBankWriter writer;
+    unsigned int failed = 0;
+    for (; arg < argc; ++arg) {
+        SampleFormat format;
+        unsigned int frequency = 0;
+        vector<char> samples;
+        string error;
+        if (!ReadWave(argv[arg], format, frequency, samples, error)) {
+            std::cerr << argv[arg] << ": " << error << std::endl;
+            failed++;
+            continue;
+        }
+        try {
+            writer.Add(ClipName(argv[arg]), format, frequency,
+                       samples.empty() ? NULL : &samples[0], samples.size(),
+                       adpcm && samples.size() > adpcmAbove);
+        } catch (Exception& e) {
+            std::cerr << argv[arg] << ": " << e.what() << std::endl;
+            failed++;
+        }
+    }
+    try {
+        writer.Write(output);
+    } catch (Exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "packed " << writer.GetCount() << " clips into " << output;
+    if (failed)
+        std::cout << ", " << failed << " failed";
+    std::cout << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+// Tests of the sound system that need no audio device.
+// -------------------------------------------------------------------
+// Copyright (C) 2007 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+// Usage: SoundSystemTest
+//
+// Exercises the sound bookkeeping of a sound system that is never
+// initialized, so it runs without an OpenAL device. Exits non-zero
+// on any failed check.
+
+#include <Sound/OpenALSoundSystem.h>
+#include <Sound/IStereoSound.h>
+#include <Sound/IMonoSound.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine::Sound;
+using OpenEngine::Resources::ISoundResource;
+using OpenEngine::Resources::ISoundResourcePtr;
+using OpenEngine::Resources::SoundFormat;
+using OpenEngine::Resources::MONO;
+using OpenEngine::Resources::STEREO;
+using std::string;
+using std::vector;
+
+/**
+ * 16 bit silence held in memory.
+ */
+class SilenceResource : public ISoundResource {
+private:
+    SoundFormat format;
+    vector<short> samples;
+public:
+    SilenceResource(SoundFormat format, unsigned int frames)
+        : format(format), samples(frames * (format == MONO ? 1 : 2)) {}
+    char* GetBuffer() { return (char*)&samples[0]; }
+    unsigned int GetBufferSize() { return samples.size() * sizeof(short); }
+    unsigned int GetFrequency() { return 44100; }
+    unsigned int GetBitsPerSample() { return 16; }
+    SoundFormat GetFormat() { return format; }
+    void Load() {}
+    void Unload() {}
+};
+
+static unsigned int failures = 0;
+
+static void Check(bool ok, const string& what) {
+    if (ok) return;
+    std::cout << "FAIL " << what << std::endl;
+    failures++;
+}
+
+// destroying a stereo sound through one of its channels releases
+// the whole sound once
+static void TestDestroyThroughChannel(bool left) {
+    string name = string("destroy through the ") + (left ? "left" : "right") + " channel";
+    OpenALSoundSystem system;
+    ISoundResourcePtr resource(new SilenceResource(STEREO, 4410));
+    IStereoSound* stereo = dynamic_cast<IStereoSound*>(system.CreateSound(resource));
+    Check(stereo != NULL, name + ": stereo resource did not give a stereo sound");
+    if (!stereo) return;
+    SoundHandle leftHandle = system.GetHandle(stereo->GetLeft());
+    SoundHandle rightHandle = system.GetHandle(stereo->GetRight());
+    Check(system.GetSound(leftHandle) == stereo, name + ": left channel not owned by the sound");
+    Check(system.GetSound(rightHandle) == stereo, name + ": right channel not owned by the sound");
+
+    system.DestroySound(left ? stereo->GetLeft() : stereo->GetRight());
+    Check(!system.IsValid(leftHandle), name + ": left voice still valid");
+    Check(!system.IsValid(rightHandle), name + ": right voice still valid");
+    // only the stereo sound keeps the resource
+    Check(resource.use_count() == 1, name + ": stereo sound not deleted");
+}
+
+static void TestDestroyStereo() {
+    OpenALSoundSystem system;
+    ISoundResourcePtr resource(new SilenceResource(STEREO, 4410));
+    ISound* sound = system.CreateSound(resource);
+    SoundHandle handle = system.GetHandle(sound);
+    system.DestroySound(sound);
+    Check(!system.IsValid(handle), "destroy stereo: voice still valid");
+    Check(resource.use_count() == 1, "destroy stereo: sound not deleted");
+}
+
+int main(int argc, char** argv) {
+    TestDestroyThroughChannel(true);
+    TestDestroyThroughChannel(false);
+    TestDestroyStereo();
+    if (failures) {
+        std::cout << failures << " sound system checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all sound system checks passed" << std::endl;
+    return 0;
+}